@@ -11,6 +11,14 @@ BEGIN {
 # skip uninteresting lines
 /^ *(EXPORTS|;)/ { next }
 
+# process aliased symbols using "symbol=internal  @ord" format
+/^[ \t]*[A-Za-z0-9_]+=[A-Za-z0-9_]+[ \t]+@[0-9]+/ {
+  split( $1, names, "=" )
+  sub( /@/, "", $2 ) # kill of the at sign in ordinal
+  printf( "++%s.%s..%s.%s\n", names[2], ModuleName, names[1], $2 ) > OUTFILE
+  next
+}
+
 # process symbols with ordinals using "symbol  @ord" format
 /^[ \t]*[A-Za-z0-9_]+[ \t]+@[0-9]+/ {
   sub( /@/, "", $2 ) # kill of the at sign in ordinal
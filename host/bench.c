@@ -0,0 +1,673 @@
+/*
+ *  Open Winsock - host build benchmarks
+ *  Copyright (C) 2025  @stsp
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The peer side of each connection talks to libd2sock directly, like a
+ * remote host would; the app side goes through the DLL. Times are wall
+ * clock, the message loop is the emulated one from win16.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <winsock.h>
+#include "owinsock.h"
+#include "host.h"
+
+#define APPWND 1000
+#define APPWND2 1001
+#define WM_SOCK (WM_USER + 1)
+#define WM_HOST (WM_USER + 2)
+#define MAX_PAIRS 100
+
+static void (*on_msg)(const MSG *msg);
+
+void host_app_msg(const MSG *msg)
+{
+    if (on_msg)
+        on_msg(msg);
+}
+
+HTASK host_wnd_task(HWND hwnd)
+{
+    return hwnd == APPWND2 ? 2 : 1;
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void pump_once(void)
+{
+    MSG m;
+
+    while (PeekMessage(&m, 0, 0, 0, PM_REMOVE))
+        DispatchMessage(&m);
+}
+
+static void tcp_pair(SOCKET *c, SOCKET *a)
+{
+    struct sockaddr_in sin;
+    SOCKET l = socket(AF_INET, SOCK_STREAM, 0);
+    int len = sizeof(sin);
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(0x7f000001);
+    bind(l, (struct sockaddr *)&sin, sizeof(sin));
+    listen(l, 5);
+    getsockname(l, (struct sockaddr *)&sin, &len);
+    *c = socket(AF_INET, SOCK_STREAM, 0);
+    connect(*c, (struct sockaddr *)&sin, sizeof(sin));
+    *a = accept(l, NULL, NULL);
+    closesocket(l);
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* --- data arrival to FD_READ delivery --------------------------------- */
+
+static int lat_got;
+
+static void lat_msg(const MSG *msg)
+{
+    if (msg->message == WM_SOCK &&
+            WSAGETSELECTEVENT(msg->lParam) == FD_READ)
+        lat_got++;
+}
+
+static void bench_latency(int iters, int gap_ms)
+{
+    double *lat = calloc(iters, sizeof(double));
+    double sum = 0;
+    SOCKET c, a;
+    char b;
+    int i;
+
+    tcp_pair(&c, &a);
+    on_msg = lat_msg;
+    WSAAsyncSelect(a, APPWND, WM_SOCK, FD_READ);
+    for (i = 0; i < iters; i++) {
+        double t0, deadline;
+
+        /* let the dispatcher back off, like an idle app would */
+        host_pump(gap_ms);
+        lat_got = 0;
+        t0 = now_ms();
+        send(c, "x", 1, 0);
+        deadline = t0 + 2000;
+        while (!lat_got && now_ms() < deadline)
+            pump_once();
+        lat[i] = now_ms() - t0;
+        sum += lat[i];
+        ws_recv(a, &b, 1, 0);
+    }
+    qsort(lat, iters, sizeof(double), cmp_double);
+    printf("latency, idle %4d ms: avg %7.2f  p50 %7.2f  p99 %7.2f  "
+            "max %7.2f ms\n", gap_ms, sum / iters, lat[iters / 2],
+            lat[iters * 99 / 100], lat[iters - 1]);
+    WSAAsyncSelect(a, APPWND, 0, 0);
+    ws_closesocket(a);
+    closesocket(c);
+    free(lat);
+    on_msg = NULL;
+}
+
+/* --- ping-pong over N registered sockets ------------------------------ */
+
+static SOCKET peer[1024];
+static long ev_count;
+
+static void ev_msg(const MSG *msg)
+{
+    char b[16];
+
+    if (msg->message != WM_SOCK ||
+            WSAGETSELECTEVENT(msg->lParam) != FD_READ)
+        return;
+    if (ws_recv(msg->wParam, b, sizeof(b), 0) > 0) {
+        ev_count++;
+        send(peer[msg->wParam], "x", 1, 0);
+    }
+}
+
+static void bench_events(int pairs, int ms)
+{
+    SOCKET c[MAX_PAIRS], a[MAX_PAIRS];
+    double t0, t;
+    int i;
+
+    for (i = 0; i < pairs; i++) {
+        tcp_pair(&c[i], &a[i]);
+        peer[a[i]] = c[i];
+        WSAAsyncSelect(a[i], APPWND, WM_SOCK, FD_READ);
+    }
+    on_msg = ev_msg;
+    ev_count = 0;
+    host_cnt.selects = 0;
+    for (i = 0; i < pairs; i++)
+        send(c[i], "x", 1, 0);
+    t0 = now_ms();
+    host_pump(ms);
+    t = now_ms() - t0;
+    printf("events, %3d sockets: %9.0f events/s, %7.2f events/select\n",
+            pairs, ev_count * 1000 / t,
+            host_cnt.selects ? (double)ev_count / host_cnt.selects : 0);
+    on_msg = NULL;
+    for (i = 0; i < pairs; i++) {
+        WSAAsyncSelect(a[i], APPWND, 0, 0);
+        ws_closesocket(a[i]);
+        closesocket(c[i]);
+    }
+    host_pump(10);
+}
+
+/* --- header + body writes: two send()s vs one OWSSendV() ------------- */
+
+static void bench_sendv(const char *what, int vectored, int ms)
+{
+    static char hdr[8], body[120], sink[65536];
+    struct ows_buf v[2] = { { hdr, sizeof(hdr) }, { body, sizeof(body) } };
+    u_long on = 1;
+    unsigned long calls, d2s = 0;
+    double t0, t;
+    long msgs = 0, bytes = 0;
+    SOCKET c, a;
+
+    tcp_pair(&c, &a);
+    ioctlsocket(c, FIONBIO, &on);
+    /* measure the calls themselves, not write combining */
+    ws_setsockopt(a, IPPROTO_TCP, TCP_NODELAY, (char *)&on, sizeof(on));
+    t0 = now_ms();
+    do {
+        int i;
+
+        calls = host_cnt.d2s_calls;
+        for (i = 0; i < 64; i++) {
+            if (vectored) {
+                OWSSendV(a, v, 2, 0);
+            } else {
+                ws_send(a, hdr, sizeof(hdr), 0);
+                ws_send(a, body, sizeof(body), 0);
+            }
+            msgs++;
+        }
+        d2s += host_cnt.d2s_calls - calls;
+        while (recv(c, sink, sizeof(sink), 0) > 0);
+        bytes = msgs * (sizeof(hdr) + sizeof(body));
+        t = now_ms() - t0;
+    } while (t < ms);
+    printf("send, %-8s: %9.0f msgs/s %7.1f MB/s, %.2f host calls/msg\n",
+            what, msgs * 1000 / t, bytes / t / 1e3, (double)d2s / msgs);
+    ws_closesocket(a);
+    closesocket(c);
+}
+
+/* --- SNMP-style poller: a burst of requests, one recvfrom() per FD_READ
+ * for the replies. Host calls are the app's, its sendto()s included. Run
+ * with OWS_UDPQUEUE=0 to compare against a host call per datagram. */
+
+static SOCKET udp_sock;
+static long udp_got;
+
+static void udp_msg(const MSG *msg)
+{
+    char b[512];
+
+    if (msg->message == WM_SOCK &&
+            WSAGETSELECTEVENT(msg->lParam) == FD_READ &&
+            ws_recvfrom(udp_sock, b, sizeof(b), 0, NULL, NULL) > 0)
+        udp_got++;
+}
+
+static SOCKET udp_bound(struct sockaddr_in *sin)
+{
+    SOCKET u = socket(AF_INET, SOCK_DGRAM, 0);
+    int len = sizeof(*sin);
+
+    memset(sin, 0, sizeof(*sin));
+    sin->sin_family = AF_INET;
+    sin->sin_addr.s_addr = htonl(0x7f000001);
+    bind(u, (struct sockaddr *)sin, sizeof(*sin));
+    getsockname(u, (struct sockaddr *)sin, &len);
+    return u;
+}
+
+static void bench_udp(int ms)
+{
+    static char pkt[100];
+    struct sockaddr_in usin, psin;
+    SOCKET p = udp_bound(&psin);
+    unsigned long calls, polls;
+    double t0, t;
+    long sent = 0;
+
+    udp_sock = udp_bound(&usin);
+    /* non-blocking by this alone, which the queue needs */
+    WSAAsyncSelect(udp_sock, APPWND, WM_SOCK, FD_READ);
+    on_msg = udp_msg;
+    udp_got = 0;
+    calls = host_cnt.d2s_calls;
+    polls = host_cnt.selects;
+    t0 = now_ms();
+    do {
+        int i;
+
+        for (i = 0; i < 32; i++)
+            ws_sendto(udp_sock, pkt, sizeof(pkt), 0,
+                    (struct sockaddr *)&psin, sizeof(psin));
+        for (i = 0; i < 32; i++) {
+            recvfrom(p, pkt, sizeof(pkt), 0, NULL, NULL);
+            sendto(p, pkt, sizeof(pkt), 0, (struct sockaddr *)&usin,
+                    sizeof(usin));
+        }
+        sent += 32;
+        while (udp_got < sent)
+            pump_once();
+        t = now_ms() - t0;
+    } while (t < ms);
+    calls = host_cnt.d2s_calls - calls - 2 * sent;
+    printf("udp: %9.0f dgrams/s, %.2f host calls/dgram, "
+            "%.2f selects/dgram\n", udp_got * 1000 / t,
+            (double)calls / udp_got,
+            (double)(host_cnt.selects - polls) / udp_got);
+    on_msg = NULL;
+    WSAAsyncSelect(udp_sock, APPWND, 0, 0);
+    ws_closesocket(udp_sock);
+    closesocket(p);
+}
+
+/* --- keystroke-sized sends, flushed when back to the message loop ---- */
+
+static void bench_chatty(const char *what, int nodelay, int ms)
+{
+    static char sink[65536];
+    u_long on = 1;
+    unsigned long calls, d2s = 0;
+    double t0, t;
+    long sends = 0;
+    SOCKET c, a;
+
+    tcp_pair(&c, &a);
+    ioctlsocket(c, FIONBIO, &on);
+    ws_setsockopt(a, IPPROTO_TCP, TCP_NODELAY, (char *)&nodelay,
+            sizeof(nodelay));
+    t0 = now_ms();
+    do {
+        int i;
+
+        calls = host_cnt.d2s_calls;
+        for (i = 0; i < 16; i++)
+            ws_send(a, "k", 1, 0);
+        pump_once();
+        d2s += host_cnt.d2s_calls - calls;
+        sends += 16;
+        while (recv(c, sink, sizeof(sink), 0) > 0);
+        t = now_ms() - t0;
+    } while (t < ms);
+    printf("send 1, %-10s: %9.0f sends/s, %.3f host calls/send\n",
+            what, sends * 1000 / t, (double)d2s / sends);
+    ws_closesocket(a);
+    closesocket(c);
+}
+
+/* --- byte-at-a-time reader: plain libd2sock recv() vs read-ahead ----- */
+
+static void bench_recv1(const char *what, int ahead, int ms)
+{
+    static char chunk[4096];
+    unsigned long calls, d2s = 0;
+    double t0, t;
+    long bytes = 0;
+    SOCKET c, a;
+    char b;
+
+    tcp_pair(&c, &a);
+    t0 = now_ms();
+    do {
+        int i;
+
+        send(c, chunk, sizeof(chunk), 0);
+        calls = host_cnt.d2s_calls;
+        for (i = 0; i < sizeof(chunk); i++) {
+            if ((ahead ? ws_recv(a, &b, 1, 0) : recv(a, &b, 1, 0)) != 1)
+                break;
+        }
+        d2s += host_cnt.d2s_calls - calls;
+        bytes += i;
+        t = now_ms() - t0;
+    } while (t < ms);
+    printf("recv 1, %-10s: %7.1f MB/s, %.3f host calls/byte\n",
+            what, bytes / t / 1e3, (double)d2s / bytes);
+    ws_closesocket(a);
+    closesocket(c);
+}
+
+/* --- status queries an app polls: plain libd2sock vs answered locally - */
+
+static void bench_query(const char *what, int local, int ms)
+{
+    struct sockaddr_in sin;
+    unsigned long calls = host_cnt.d2s_calls;
+    double t0, t;
+    long n = 0;
+    SOCKET c, a;
+    u_long nr;
+    int v, len;
+
+    tcp_pair(&c, &a);
+    send(c, "x", 1, 0);
+    t0 = now_ms();
+    do {
+        int i;
+
+        for (i = 0; i < 256; i++) {
+            len = sizeof(v);
+            if (local) {
+                ws_ioctlsocket(a, FIONREAD, &nr);
+                ws_getsockopt(a, SOL_SOCKET, SO_RCVBUF, (char *)&v, &len);
+                len = sizeof(sin);
+                ws_getpeername(a, (struct sockaddr *)&sin, &len);
+            } else {
+                ioctlsocket(a, FIONREAD, &nr);
+                getsockopt(a, SOL_SOCKET, SO_RCVBUF, (char *)&v, &len);
+                len = sizeof(sin);
+                getpeername(a, (struct sockaddr *)&sin, &len);
+            }
+        }
+        n += 3 * 256;
+        t = now_ms() - t0;
+    } while (t < ms);
+    printf("query, %-6s: %9.0f calls/s, %.3f host calls/call\n",
+            what, n * 1000 / t, (double)(host_cnt.d2s_calls - calls) / n);
+    ws_closesocket(a);
+    closesocket(c);
+}
+
+/* --- two tasks: a light app's FD_READ latency while another floods ---
+ * Win16 switches tasks when the running one's queue is empty, so task 1
+ * runs until then, or for a 100 ms slice if it never gets there. Run with
+ * OWS_EVENTBUDGET=0 to compare against unbudgeted dispatch. */
+
+static int share_got;
+
+static void share_msg(const MSG *msg)
+{
+    if (msg->hwnd == APPWND2)
+        share_got++;
+    else
+        ev_msg(msg);
+}
+
+static void bench_share(int iters)
+{
+    SOCKET c[MAX_PAIRS], a[MAX_PAIRS], lc, la;
+    double *lat = calloc(iters, sizeof(double));
+    double t0, start, sum = 0;
+    WSADATA d;
+    MSG m;
+    char b;
+    int i;
+
+    host_set_task(2);
+    WSAStartup(0x0101, &d);
+    tcp_pair(&lc, &la);
+    WSAAsyncSelect(la, APPWND2, WM_SOCK, FD_READ);
+    host_set_task(1);
+    for (i = 0; i < MAX_PAIRS; i++) {
+        tcp_pair(&c[i], &a[i]);
+        peer[a[i]] = c[i];
+        WSAAsyncSelect(a[i], APPWND, WM_SOCK, FD_READ);
+    }
+    on_msg = share_msg;
+    ev_count = 0;
+    for (i = 0; i < MAX_PAIRS; i++)
+        send(c[i], "x", 1, 0);
+    start = now_ms();
+    for (i = 0; i < iters; i++) {
+        share_got = 0;
+        t0 = now_ms();
+        send(lc, "x", 1, 0);
+        while (!share_got && now_ms() < t0 + 2000) {
+            double slice = now_ms() + 100;
+
+            host_set_task(1);
+            while (now_ms() < slice && PeekMessage(&m, 0, 0, 0, PM_REMOVE))
+                DispatchMessage(&m);
+            host_set_task(2);
+            pump_once();
+        }
+        lat[i] = now_ms() - t0;
+        sum += lat[i];
+        ws_recv(la, &b, 1, 0);
+    }
+    qsort(lat, iters, sizeof(double), cmp_double);
+    printf("shared, %3d bulk sockets: light avg %7.2f  p50 %7.2f  "
+            "max %7.2f ms, bulk %9.0f events/s\n", MAX_PAIRS, sum / iters,
+            lat[iters / 2], lat[iters - 1], ev_count * 1000 /
+            (now_ms() - start));
+    on_msg = NULL;
+    for (i = 0; i < MAX_PAIRS; i++) {
+        WSAAsyncSelect(a[i], APPWND, 0, 0);
+        ws_closesocket(a[i]);
+        closesocket(c[i]);
+    }
+    host_pump(10);
+    host_set_task(2);
+    WSAAsyncSelect(la, APPWND2, 0, 0);
+    ws_closesocket(la);
+    closesocket(lc);
+    WSACleanup();
+    host_pump(10);
+    host_set_task(1);
+    free(lat);
+}
+
+/* --- WSAAsyncGetHostByName() round trips ------------------------------ */
+
+static int dns_got;
+
+static void dns_msg(const MSG *msg)
+{
+    if (msg->message == WM_HOST)
+        dns_got++;
+}
+
+static void bench_dns(const char *what, int cached, int batch, int ms)
+{
+    static char buf[MAX_PAIRS][MAXGETHOSTSTRUCT];
+    char name[32];
+    double t0, t;
+    long n = 0;
+    int i;
+
+    OWSFlushDnsCache();
+    on_msg = dns_msg;
+    t0 = now_ms();
+    do {
+        dns_got = 0;
+        for (i = 0; i < batch; i++) {
+            snprintf(name, sizeof(name), "h%ld.test", cached ? 1 : n + i);
+            WSAAsyncGetHostByName(APPWND, WM_HOST, name, buf[i],
+                    MAXGETHOSTSTRUCT);
+        }
+        while (dns_got < batch)
+            pump_once();
+        n += batch;
+        t = now_ms() - t0;
+    } while (t < ms);
+    printf("dns, %-8s batch %3d: %9.0f lookups/s\n", what, batch,
+            n * 1000 / t);
+    on_msg = NULL;
+}
+
+/* --- a page's worth of names at once: libd2sock's resolver, nested in
+ * the blocking hook one lookup inside the other, against the DLL's
+ * resolver engine and a stub server. Each answer takes 20 ms. */
+
+static void bench_resolver(const char *what, int engine, int names)
+{
+    static char buf[MAX_PAIRS][MAXGETHOSTSTRUCT];
+    unsigned long hooks = host_cnt.hooks;
+    char srv[32], name[32];
+    double t0, t;
+    WSADATA d;
+    int i;
+
+    if (engine) {
+        snprintf(srv, sizeof(srv), "127.0.0.1:%d", host_dns_start());
+        setenv("OWS_DNSSERVER", srv, 1);
+        host_dns.delay = 20;
+    } else {
+        setenv("OWS_HOST_DNS_DELAY", "20", 1);
+    }
+    /* resolver settings are read when the first app starts */
+    WSACleanup();
+    WSAStartup(0x0101, &d);
+    OWSFlushDnsCache();
+    on_msg = dns_msg;
+    dns_got = 0;
+    t0 = now_ms();
+    for (i = 0; i < names; i++) {
+        snprintf(name, sizeof(name), "h%d.test", i + 1);
+        WSAAsyncGetHostByName(APPWND, WM_HOST, name, buf[i],
+                MAXGETHOSTSTRUCT);
+    }
+    while (dns_got < names && now_ms() - t0 < 10000)
+        pump_once();
+    t = now_ms() - t0;
+    printf("resolve %d names, %-6s: %7.1f ms, %6.0f lookups/s, "
+            "%lu hook calls\n", names, what, t, dns_got * 1000 / t,
+            host_cnt.hooks - hooks);
+    on_msg = NULL;
+    unsetenv("OWS_DNSSERVER");
+    unsetenv("OWS_HOST_DNS_DELAY");
+    host_dns.delay = 0;
+    WSACleanup();
+    WSAStartup(0x0101, &d);
+}
+
+/* --- navigating away: a page's lookups are cancelled while the first
+ * is in progress, then the next page needs one name. Each resolver round
+ * trip takes 20 ms. Host calls and replies nobody wants are counted. */
+
+static HANDLE page_h[MAX_PAIRS], next_h;
+static int page_n, stale;
+
+static void cancel_msg(const MSG *msg)
+{
+    int i;
+
+    if (msg->message == WM_SOCK) {
+        for (i = 0; i < page_n; i++)
+            WSACancelAsyncRequest(page_h[i]);
+    } else if (msg->message == WM_HOST) {
+        if (msg->wParam == next_h)
+            dns_got++;
+        else
+            stale++;
+    }
+}
+
+static void bench_dns_cancel(int batch, int iters)
+{
+    static char buf[MAX_PAIRS][MAXGETHOSTSTRUCT];
+    unsigned long resolves = host_cnt.resolves;
+    char name[32];
+    double t0, sum = 0;
+    int i, j;
+
+    setenv("OWS_HOST_DNS_DELAY", "20", 1);
+    OWSFlushDnsCache();
+    on_msg = cancel_msg;
+    stale = 0;
+    for (j = 0; j < iters; j++) {
+        for (i = 0; i < batch; i++) {
+            snprintf(name, sizeof(name), "h%d.test", j * batch + i);
+            page_h[i] = WSAAsyncGetHostByName(APPWND, WM_HOST, name, buf[i],
+                    MAXGETHOSTSTRUCT);
+        }
+        page_n = batch;
+        /* the user clicks away while the first name resolves */
+        PostMessage(APPWND, WM_SOCK, 0, 0);
+        dns_got = 0;
+        next_h = 0;
+        t0 = now_ms();
+        pump_once();
+        snprintf(name, sizeof(name), "next%d.test", j);
+        next_h = WSAAsyncGetHostByName(APPWND, WM_HOST, name, buf[0],
+                MAXGETHOSTSTRUCT);
+        while (!dns_got)
+            pump_once();
+        sum += now_ms() - t0;
+    }
+    host_pump(10);
+    printf("dns, cancel %3d: next page %7.2f ms, %.1f resolves, "
+            "%.1f stale replies/page\n", batch, sum / iters,
+            (double)(host_cnt.resolves - resolves) / iters,
+            (double)stale / iters);
+    on_msg = NULL;
+    unsetenv("OWS_HOST_DNS_DELAY");
+}
+
+int main(int argc, char *argv[])
+{
+    WSADATA d;
+    int ms = argc > 1 ? atoi(argv[1]) : 1000;
+
+    LibMain(1, 0, 1024, "");
+    if (WSAStartup(0x0101, &d)) {
+        printf("WSAStartup failed\n");
+        return 1;
+    }
+    bench_latency(50, 0);
+    bench_latency(20, 1000);
+    bench_events(1, ms);
+    bench_events(16, ms);
+    bench_events(MAX_PAIRS, ms);
+    bench_share(20);
+    bench_sendv("send x2", 0, ms);
+    bench_sendv("OWSSendV", 1, ms);
+    bench_udp(ms);
+    bench_chatty("nodelay", 1, ms);
+    bench_chatty("combined", 0, ms);
+    bench_recv1("direct", 0, ms);
+    bench_recv1("readahead", 1, ms);
+    bench_query("host", 0, ms);
+    bench_query("local", 1, ms);
+    bench_dns("uncached", 0, 1, ms);
+    bench_dns("uncached", 0, 32, ms);
+    bench_dns("cached", 1, 1, ms);
+    bench_dns("cached", 1, 32, ms);
+    bench_dns_cancel(16, 5);
+    bench_resolver("nested", 0, MAX_PAIRS);
+    bench_resolver("engine", 1, MAX_PAIRS);
+    WSACleanup();
+    WEP(0);
+    return 0;
+}
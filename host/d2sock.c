@@ -0,0 +1,785 @@
+/*
+ *  Open Winsock - libd2sock emulation on top of linux sockets
+ *  Copyright (C) 2025  @stsp
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * SOCKETs are linux descriptors. All descriptors are non-blocking
+ * underneath, blocking mode is emulated the way libd2sock does it:
+ * by calling the blocking hook until the operation can proceed.
+ * Every entry point counts as one host transition.
+ */
+
+#define _GNU_SOURCE
+#define D2H_IMPL
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+/* winsock.h below redefines FIONREAD with the winsock value */
+static const unsigned long host_fionread = FIONREAD;
+
+#include <winsock.h>
+#include <d2sock.h>
+#include "host.h"
+
+#define MAX_FDS 1024
+
+static int (*blk_hook)(void *arg);
+static void (*dbg_hook)(const char *msg);
+static int (*close_hook)(int s, void *arg);
+static void *blk_arg[MAX_FDS];
+static void *close_arg[MAX_FDS];
+static char nonblock[MAX_FDS];
+static char connecting[MAX_FDS];
+static int send_limit;
+
+#define ENTER() host_cnt.d2s_calls++
+
+void d2s_set_blocking_hook(int (*hook)(void *arg))
+{
+    blk_hook = hook;
+}
+
+void d2s_set_debug_hook(void (*hook)(const char *msg))
+{
+    dbg_hook = hook;
+}
+
+void d2s_set_close_hook(int (*hook)(int s, void *arg))
+{
+    close_hook = hook;
+}
+
+void d2s_set_blocking_arg(int s, void *arg)
+{
+    if (s >= 0 && s < MAX_FDS)
+        blk_arg[s] = arg;
+}
+
+void d2s_set_close_arg(int s, void *arg)
+{
+    if (s >= 0 && s < MAX_FDS)
+        close_arg[s] = arg;
+}
+
+void *d2s_get_close_arg(int s)
+{
+    if (s >= 0 && s < MAX_FDS)
+        return close_arg[s];
+    return NULL;
+}
+
+int host_sock_blocking(SOCKET s)
+{
+    return !nonblock[s];
+}
+
+void host_set_send_limit(int limit)
+{
+    send_limit = limit;
+}
+
+/* returns 0 if the blocking call was cancelled */
+static int blk_wait(int s, short events)
+{
+    struct pollfd pfd = { .fd = s, .events = events };
+
+    for (;;) {
+        if (poll(&pfd, 1, 0) > 0)
+            return 1;
+        host_cnt.hooks++;
+        if (!blk_hook || !blk_hook(s < MAX_FDS ? blk_arg[s] : NULL)) {
+            errno = EINTR;
+            return 0;
+        }
+    }
+}
+
+static void to_ws_err(void)
+{
+    switch (errno) {
+    case EWOULDBLOCK:
+    case EINPROGRESS:
+        errno = EAGAIN;
+        break;
+    case ENOTCONN:
+        errno = EINVAL;
+        break;
+    }
+}
+
+/* u_long is wider here than in Win16, so sin_addr is further down in
+ * ws_sockaddr_in than in the linux one: convert field by field */
+static void to_host_sin(struct sockaddr_in *sin, const struct ws_sockaddr *a)
+{
+    const struct ws_sockaddr_in *w = (const struct ws_sockaddr_in *)a;
+
+    memset(sin, 0, sizeof(*sin));
+    sin->sin_family = AF_INET;
+    sin->sin_port = w->sin_port;
+    sin->sin_addr.s_addr = (uint32_t)w->sin_addr.s_addr;
+}
+
+static void to_ws_sin(struct ws_sockaddr *a, int *len,
+                      const struct sockaddr_in *sin)
+{
+    struct ws_sockaddr_in w;
+
+    memset(&w, 0, sizeof(w));
+    w.sin_family = AF_INET;
+    w.sin_port = sin->sin_port;
+    w.sin_addr.s_addr = sin->sin_addr.s_addr;
+    memcpy(a, &w, *len < (int)sizeof(w) ? *len : (int)sizeof(w));
+    *len = sizeof(w);
+}
+
+SOCKET d2h_accept(SOCKET s, struct ws_sockaddr *addr, int *addrlen)
+{
+    struct sockaddr_in sin;
+    socklen_t len = sizeof(sin);
+    int fd;
+
+    ENTER();
+    for (;;) {
+        fd = accept4(s, (struct sockaddr *)&sin, &len, SOCK_NONBLOCK);
+        if (fd >= 0)
+            break;
+        if (errno != EAGAIN || nonblock[s] || !blk_wait(s, POLLIN)) {
+            to_ws_err();
+            return INVALID_SOCKET;
+        }
+    }
+    nonblock[fd] = 0;
+    if (addr && addrlen)
+        to_ws_sin(addr, addrlen, &sin);
+    return fd;
+}
+
+int d2h_bind(SOCKET s, const struct ws_sockaddr *addr, int namelen)
+{
+    struct sockaddr_in sin;
+
+    ENTER();
+    to_host_sin(&sin, addr);
+    return bind(s, (struct sockaddr *)&sin, sizeof(sin));
+}
+
+int d2h_closesocket(SOCKET s)
+{
+    ENTER();
+    if (s < MAX_FDS && close_arg[s] && close_hook) {
+        if (!close_hook(s, close_arg[s]))
+            return 0;
+    }
+    if (s < MAX_FDS) {
+        blk_arg[s] = NULL;
+        close_arg[s] = NULL;
+        nonblock[s] = 0;
+        connecting[s] = 0;
+    }
+    return close(s);
+}
+
+int d2h_connect(SOCKET s, const struct ws_sockaddr *name, int namelen)
+{
+    struct sockaddr_in sin;
+    int rc;
+
+    ENTER();
+    to_host_sin(&sin, name);
+    rc = connect(s, (struct sockaddr *)&sin, sizeof(sin));
+    if (rc == 0 || errno != EINPROGRESS) {
+        to_ws_err();
+        return rc;
+    }
+    if (nonblock[s]) {
+        connecting[s] = 1;
+        errno = EAGAIN;
+        return -1;
+    }
+    if (!blk_wait(s, POLLOUT))
+        return -1;
+    return aconnect(s) ? -1 : 0;
+}
+
+int aconnect(int s)
+{
+    struct pollfd pfd = { .fd = s, .events = POLLOUT };
+    int err = 0;
+    socklen_t len = sizeof(err);
+
+    ENTER();
+    if (poll(&pfd, 1, 0) <= 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+    connecting[s] = 0;
+    getsockopt(s, SOL_SOCKET, SO_ERROR, &err, &len);
+    if (err) {
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
+
+int d2h_getpeername(SOCKET s, struct ws_sockaddr *name, int *namelen)
+{
+    struct sockaddr_in sin;
+    socklen_t len = sizeof(sin);
+    int rc;
+
+    ENTER();
+    rc = getpeername(s, (struct sockaddr *)&sin, &len);
+    if (rc == 0)
+        to_ws_sin(name, namelen, &sin);
+    to_ws_err();
+    return rc;
+}
+
+int d2h_getsockname(SOCKET s, struct ws_sockaddr *name, int *namelen)
+{
+    struct sockaddr_in sin;
+    socklen_t len = sizeof(sin);
+    int rc;
+
+    ENTER();
+    rc = getsockname(s, (struct sockaddr *)&sin, &len);
+    if (rc == 0)
+        to_ws_sin(name, namelen, &sin);
+    return rc;
+}
+
+static int map_opt(int level, int optname, int *l, int *o)
+{
+    *l = level;
+    *o = optname;
+    if (level == 0xffff) {
+        *l = SOL_SOCKET;
+        switch (optname) {
+        case 0x0004: *o = SO_REUSEADDR; break;
+        case 0x0008: *o = SO_KEEPALIVE; break;
+        case 0x0020: *o = SO_BROADCAST; break;
+        case 0x0100: *o = SO_OOBINLINE; break;
+        case 0x1001: *o = SO_SNDBUF; break;
+        case 0x1002: *o = SO_RCVBUF; break;
+        case 0x1007: *o = SO_ERROR; break;
+        case 0x1008: *o = SO_TYPE; break;
+        default: return -1;
+        }
+    } else if (level == IPPROTO_TCP && optname == 1) {
+        *o = TCP_NODELAY;
+    }
+    return 0;
+}
+
+int d2h_getsockopt(SOCKET s, int level, int optname, char *optval, int *optlen)
+{
+    int l, o, v = 0;
+    socklen_t len = sizeof(v);
+
+    ENTER();
+    if (level == 0xffff && optname == 0x0080) {
+        struct linger hl;
+        struct ws_linger *wl = (struct ws_linger *)optval;
+
+        len = sizeof(hl);
+        if (*optlen < (int)sizeof(*wl)) {
+            errno = EFAULT;
+            return -1;
+        }
+        if (getsockopt(s, SOL_SOCKET, SO_LINGER, &hl, &len))
+            return -1;
+        wl->l_onoff = hl.l_onoff;
+        wl->l_linger = hl.l_linger;
+        *optlen = sizeof(*wl);
+        return 0;
+    }
+    if (map_opt(level, optname, &l, &o)) {
+        errno = ENOPROTOOPT;
+        return -1;
+    }
+    if (getsockopt(s, l, o, &v, &len))
+        return -1;
+    if (*optlen >= (int)sizeof(int)) {
+        memcpy(optval, &v, sizeof(int));
+        *optlen = sizeof(int);
+    } else {
+        *(short *)optval = v;
+        *optlen = sizeof(short);
+    }
+    return 0;
+}
+
+int d2h_setsockopt(SOCKET s, int level, int optname, const char *optval,
+        int optlen)
+{
+    int l, o, v;
+
+    ENTER();
+    if (level == 0xffff && optname == 0x0080) {
+        const struct ws_linger *wl = (const struct ws_linger *)optval;
+        struct linger hl = { wl->l_onoff, wl->l_linger };
+
+        return setsockopt(s, SOL_SOCKET, SO_LINGER, &hl, sizeof(hl));
+    }
+    if (map_opt(level, optname, &l, &o)) {
+        errno = ENOPROTOOPT;
+        return -1;
+    }
+    v = optlen >= (int)sizeof(int) ? *(const int *)optval :
+            *(const short *)optval;
+    return setsockopt(s, l, o, &v, sizeof(v));
+}
+
+u_long d2h_htonl(u_long hostlong)
+{
+    return htonl(hostlong);
+}
+
+u_short d2h_htons(u_short hostshort)
+{
+    return htons(hostshort);
+}
+
+u_long d2h_ntohl(u_long netlong)
+{
+    return ntohl(netlong);
+}
+
+u_short d2h_ntohs(u_short netshort)
+{
+    return ntohs(netshort);
+}
+
+unsigned long d2h_inet_addr(const char *cp)
+{
+    struct in_addr a;
+
+    if (!inet_aton(cp, &a))
+        return INADDR_NONE;
+    return a.s_addr;
+}
+
+char *d2h_inet_ntoa(struct ws_in_addr in)
+{
+    struct in_addr a = { .s_addr = in.s_addr };
+
+    return inet_ntoa(a);
+}
+
+int d2h_ioctlsocket(SOCKET s, long cmd, u_long *argp)
+{
+    int v;
+
+    ENTER();
+    if (cmd == (long)FIONBIO) {
+        nonblock[s] = !!*argp;
+        return 0;
+    }
+    if (cmd == (long)FIONREAD) {
+        if (ioctl(s, host_fionread, &v))
+            return -1;
+        *argp = v;
+        return 0;
+    }
+    errno = EINVAL;
+    return -1;
+}
+
+int d2h_listen(SOCKET s, int backlog)
+{
+    ENTER();
+    return listen(s, backlog);
+}
+
+int d2h_recv(SOCKET s, char *buf, int len, int flags)
+{
+    int rc;
+
+    ENTER();
+    for (;;) {
+        rc = recv(s, buf, len, flags & 3);
+        if (rc >= 0)
+            return rc;
+        if (errno != EAGAIN || nonblock[s] || !blk_wait(s, POLLIN))
+            break;
+    }
+    to_ws_err();
+    return -1;
+}
+
+int d2h_recvfrom(SOCKET s, char *buf, int len, int flags,
+        struct ws_sockaddr *from, int *fromlen)
+{
+    struct sockaddr_in sin;
+    socklen_t sl = sizeof(sin);
+    int rc;
+
+    ENTER();
+    for (;;) {
+        rc = recvfrom(s, buf, len, (flags & 3) | MSG_TRUNC,
+                (struct sockaddr *)&sin, &sl);
+        if (rc >= 0)
+            break;
+        if (errno != EAGAIN || nonblock[s] || !blk_wait(s, POLLIN)) {
+            to_ws_err();
+            return -1;
+        }
+    }
+    if (from && fromlen)
+        to_ws_sin(from, fromlen, &sin);
+    if (rc > len) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    return rc;
+}
+
+int d2h_select(int nfds, ws_fd_set *readfds, ws_fd_set *writefds,
+        ws_fd_set *exceptfds, const struct timeval *timeout)
+{
+    struct pollfd pfd[MAX_FDS];     /* the hook may select() again */
+    ws_fd_set *sets[3] = { readfds, writefds, exceptfds };
+    short ev[3] = { POLLIN, POLLOUT, POLLPRI };
+    int n = 0, i, j, k, rc, tmo;
+
+    ENTER();
+    host_cnt.selects++;
+    for (k = 0; k < 3; k++) {
+        if (!sets[k])
+            continue;
+        for (i = 0; i < (int)sets[k]->fd_count; i++) {
+            /* like BSD select(), sockets from nfds on are not looked at */
+            if ((int)sets[k]->fd_array[i] >= nfds)
+                continue;
+            for (j = 0; j < n; j++) {
+                if (pfd[j].fd == (int)sets[k]->fd_array[i])
+                    break;
+            }
+            if (j == n) {
+                pfd[n].fd = sets[k]->fd_array[i];
+                pfd[n].events = 0;
+                n++;
+            }
+            pfd[j].events |= ev[k];
+        }
+    }
+    tmo = timeout ? timeout->tv_sec * 1000 + timeout->tv_usec / 1000 : -1;
+    /* a wait runs the blocking hook every 10 ms, as libd2sock's does */
+    if (blk_hook && tmo) {
+        struct timespec ts0, ts;
+        int left = tmo;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts0);
+        while (!(rc = poll(pfd, n, tmo < 0 ? 10 : min(left, 10)))) {
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            left = tmo - ((ts.tv_sec - ts0.tv_sec) * 1000 +
+                    (ts.tv_nsec - ts0.tv_nsec) / 1000000);
+            if (tmo > 0 && left <= 0)
+                break;
+            host_cnt.hooks++;
+            if (!blk_hook(NULL)) {
+                errno = EINTR;
+                return -1;
+            }
+        }
+    } else {
+        rc = poll(pfd, n, tmo);
+    }
+    if (rc < 0)
+        return -1;
+    if (rc > 0)
+        host_cnt.select_wakes++;
+    rc = 0;
+    for (k = 0; k < 3; k++) {
+        u_int cnt = 0;
+
+        if (!sets[k])
+            continue;
+        for (i = 0; i < (int)sets[k]->fd_count; i++) {
+            for (j = 0; j < n; j++) {
+                if (pfd[j].fd == (int)sets[k]->fd_array[i])
+                    break;
+            }
+            if (j < n && pfd[j].revents & (ev[k] | (k == 0 ? POLLHUP | POLLERR : 0) |
+                    (k == 1 ? POLLERR : 0)))
+                sets[k]->fd_array[cnt++] = sets[k]->fd_array[i];
+        }
+        sets[k]->fd_count = cnt;
+        rc += cnt;
+    }
+    return rc;
+}
+
+int d2h_send(SOCKET s, const char *buf, int len, int flags)
+{
+    int rc;
+
+    ENTER();
+    if (send_limit && len > send_limit)
+        len = send_limit;
+    for (;;) {
+        rc = send(s, buf, len, (flags & 1) | MSG_NOSIGNAL);
+        if (rc >= 0)
+            return rc;
+        if (errno != EAGAIN || nonblock[s] || !blk_wait(s, POLLOUT))
+            break;
+    }
+    to_ws_err();
+    return -1;
+}
+
+int d2h_sendto(SOCKET s, const char *buf, int len, int flags,
+        const struct ws_sockaddr *to, int tolen)
+{
+    struct sockaddr_in sin;
+
+    ENTER();
+    if (!to)
+        return d2h_send(s, buf, len, flags);
+    to_host_sin(&sin, to);
+    return sendto(s, buf, len, (flags & 1) | MSG_NOSIGNAL,
+            (struct sockaddr *)&sin, sizeof(sin));
+}
+
+int d2h_shutdown(SOCKET s, int how)
+{
+    ENTER();
+    return shutdown(s, how);
+}
+
+SOCKET d2h_socket(int af, int type, int protocol)
+{
+    int fd;
+
+    ENTER();
+    fd = socket(AF_INET, (type == 2 ? SOCK_DGRAM : SOCK_STREAM) |
+            SOCK_NONBLOCK, 0);
+    if (fd < 0 || fd >= MAX_FDS) {
+        if (fd >= 0)
+            close(fd);
+        errno = EMFILE;
+        return INVALID_SOCKET;
+    }
+    nonblock[fd] = 0;
+    return fd;
+}
+
+/* ------------------------------------------------------------------ */
+
+static struct ws_hostent *mk_hostent(const char *name, const uint32_t *addr,
+        int naddr)
+{
+    struct ws_hostent *he = calloc(1, sizeof(*he));
+    int i;
+
+    he->h_name = strdup(name);
+    he->h_aliases = calloc(1, sizeof(char *));
+    he->h_addrtype = AF_INET;
+    he->h_length = 4;
+    he->h_addr_list = calloc(naddr + 1, sizeof(char *));
+    for (i = 0; i < naddr; i++) {
+        he->h_addr_list[i] = malloc(4);
+        memcpy(he->h_addr_list[i], &addr[i], 4);
+    }
+    return he;
+}
+
+void freehostent(struct ws_hostent *he)
+{
+    char **p;
+
+    free(he->h_name);
+    for (p = he->h_aliases; *p; p++)
+        free(*p);
+    free(he->h_aliases);
+    for (p = he->h_addr_list; *p; p++)
+        free(*p);
+    free(he->h_addr_list);
+    free(he);
+}
+
+/* OWS_HOST_DNS_DELAY emulates the resolver latency, during which the
+ * blocking hook is pumped. 0 if the hook cancelled the lookup. */
+static int resolve_wait(void *arg)
+{
+    const char *d = getenv("OWS_HOST_DNS_DELAY");
+    int delay = d ? atoi(d) : 0;
+    struct timespec ts0, ts;
+
+    if (!delay)
+        return 1;
+    clock_gettime(CLOCK_MONOTONIC, &ts0);
+    do {
+        host_cnt.hooks++;
+        if (blk_hook && !blk_hook(arg))
+            return 0;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+    } while ((ts.tv_sec - ts0.tv_sec) * 1000 +
+            (ts.tv_nsec - ts0.tv_nsec) / 1000000 < delay);
+    return 1;
+}
+
+/*
+ * Names under .test resolve locally: "hN.test" gets 127.0.0.N, and
+ * "multiN.test" gets N addresses.
+ */
+static struct ws_hostent *resolve(const char *name, void *arg)
+{
+    uint32_t addrs[64];
+    int n = 0, i;
+    const char *dot = strrchr(name, '.');
+
+    host_cnt.resolves++;
+    if (!resolve_wait(arg))
+        return NULL;
+    if (dot && strcmp(dot, ".test") == 0) {
+        if (strncmp(name, "multi", 5) == 0) {
+            n = atoi(name + 5);
+            if (n > 64)
+                n = 64;
+            for (i = 0; i < n; i++)
+                addrs[i] = htonl(0x0a000001 + i);
+        } else if (strncmp(name, "nx", 2) == 0) {
+            return NULL;
+        } else {
+            n = 1;
+            addrs[0] = htonl(0x7f000000 | (atoi(name + 1) & 0xff));
+        }
+    } else {
+        struct addrinfo hints = { .ai_family = AF_INET }, *res, *r;
+
+        if (getaddrinfo(name, NULL, &hints, &res))
+            return NULL;
+        for (r = res; r && n < 64; r = r->ai_next) {
+            uint32_t a = ((struct sockaddr_in *)r->ai_addr)->sin_addr.s_addr;
+
+            for (i = 0; i < n; i++)
+                if (addrs[i] == a)
+                    break;
+            if (i == n)
+                addrs[n++] = a;
+        }
+        freeaddrinfo(res);
+    }
+    return mk_hostent(name, addrs, n);
+}
+
+struct ws_hostent *gethostbyname_ex(const char *name, void *arg)
+{
+    ENTER();
+    return resolve(name, arg);
+}
+
+struct ws_hostent *d2h_gethostbyname(const char *name)
+{
+    static struct ws_hostent *last;
+
+    ENTER();
+    if (last)
+        freehostent(last);
+    last = resolve(name, NULL);
+    return last;
+}
+
+struct ws_hostent *d2h_gethostbyaddr(const char *addr, int len, int type)
+{
+    static struct ws_hostent *last;
+    char name[64];
+    const unsigned char *a = (const unsigned char *)addr;
+    uint32_t ip;
+
+    ENTER();
+    host_cnt.resolves++;
+    if (last)
+        freehostent(last);
+    last = NULL;
+    /* like libd2sock, with no arg for the hook */
+    if (len != 4 || type != AF_INET || !resolve_wait(NULL))
+        return NULL;
+    snprintf(name, sizeof(name), "host-%d-%d-%d-%d.test",
+            a[0], a[1], a[2], a[3]);
+    memcpy(&ip, addr, 4);
+    last = mk_hostent(name, &ip, 1);
+    return last;
+}
+
+int d2h_gethostname(char *name, int namelen)
+{
+    ENTER();
+    return gethostname(name, namelen);
+}
+
+static struct ws_servent ws_se;
+static struct ws_protoent ws_pe;
+static char *no_aliases[1];
+
+static struct ws_servent *conv_se(struct servent *se)
+{
+    if (!se)
+        return NULL;
+    ws_se.s_name = se->s_name;
+    ws_se.s_aliases = no_aliases;
+    ws_se.s_port = se->s_port;
+    ws_se.s_proto = se->s_proto;
+    return &ws_se;
+}
+
+struct ws_servent *d2h_getservbyname(const char *name, const char *proto)
+{
+    ENTER();
+    return conv_se(getservbyname(name, proto));
+}
+
+struct ws_servent *d2h_getservbyport(int port, const char *proto)
+{
+    ENTER();
+    return conv_se(getservbyport(port, proto));
+}
+
+static struct ws_protoent *conv_pe(struct protoent *pe)
+{
+    if (!pe)
+        return NULL;
+    ws_pe.p_name = pe->p_name;
+    ws_pe.p_aliases = no_aliases;
+    ws_pe.p_proto = pe->p_proto;
+    return &ws_pe;
+}
+
+struct ws_protoent *d2h_getprotobyname(const char *name)
+{
+    ENTER();
+    return conv_pe(getprotobyname(name));
+}
+
+struct ws_protoent *d2h_getprotobynumber(int proto)
+{
+    ENTER();
+    return conv_pe(getprotobynumber(proto));
+}
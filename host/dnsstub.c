@@ -0,0 +1,249 @@
+/*
+ *  Open Winsock - stub DNS server for the host build
+ *  Copyright (C) 2025  @stsp
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A UDP server on 127.0.0.1 for the DLL's resolver engine (WIN.INI
+ * DnsServer), run in a thread of its own like a real server would.
+ * Names under .test get the answers the shim's resolver gives, and
+ * "cnameN.test" is an alias of "hN.test". "strayN.test" answers as
+ * "hN.test" does, after an address of "evil.test", and "lureN.test"
+ * only with that. "failN.test" gets SERVFAIL. Everything else is
+ * NXDOMAIN.
+ * Replies wait host_dns.delay ms each, independently of each other,
+ * and the first host_dns.drop queries get none.
+ */
+
+#define _GNU_SOURCE
+#define D2H_IMPL
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <winsock.h>
+#include "host.h"
+
+#define PENDING 256
+
+struct host_dns_stub host_dns;
+
+static int stub_fd = -1;
+
+static struct reply {
+    double due;
+    struct sockaddr_in to;
+    int len;
+    unsigned char msg[512];
+} pending[PENDING];
+static int npending;
+
+static double stub_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void put16(unsigned char *p, int v)
+{
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+/* A or CNAME record for the question name, which is at offset 12 */
+static unsigned char *add_rr(unsigned char *p, int type, const void *data,
+                             int len)
+{
+    put16(p, 0xc00c);
+    put16(p + 2, type);
+    put16(p + 4, 1);
+    memset(p + 6, 0, 4);
+    p[9] = 60;
+    put16(p + 10, len);
+    memcpy(p + 12, data, len);
+    return p + 12 + len;
+}
+
+/* A record of another name than the question's */
+static unsigned char *add_evil(unsigned char *p)
+{
+    static const unsigned char owner[] = "\4evil\4test";
+    static const unsigned char addr[4] = { 6, 6, 6, 6 };
+    unsigned char rr[16];
+    int n = add_rr(rr, 1, addr, 4) - rr - 2;
+
+    /* the owner in full instead of the pointer to the question */
+    memcpy(p, owner, sizeof(owner));
+    memcpy(p + sizeof(owner), rr + 2, n);
+    return p + sizeof(owner) + n;
+}
+
+/* Build the reply in r->msg from the query q, 0 if it's no query */
+static int answer(struct reply *r, const unsigned char *q, int len)
+{
+    char name[256];
+    unsigned char *p = r->msg, *qend;
+    unsigned char cname[260];
+    int n = 0, i, naddr = 0, rcode = 0, alias, evil = 0;
+    uint32_t addrs[64];
+    const char *dot;
+
+    if (len < 17 || (q[2] & 0x80) || q[5] != 1)
+        return 0;
+    for (i = 12; i < len && q[i]; i += q[i] + 1) {
+        if (q[i] > 63 || i + q[i] + 1 >= len)
+            return 0;
+        memcpy(name + n, q + i + 1, q[i]);
+        n += q[i];
+        name[n++] = '.';
+    }
+    if (n == 0 || i + 5 > len)
+        return 0;
+    name[n - 1] = '\0';
+    for (i = 0; name[i]; i++)
+        name[i] = tolower(name[i]);
+    qend = (unsigned char *)q + 12 + strlen(name) + 2 + 4;
+    alias = strncmp(name, "cname", 5) == 0;
+
+    memcpy(p, q, qend - q);
+    p[2] = 0x81;                /* response, recursion desired */
+    p[3] = 0x80;                /* recursion available */
+    p += qend - q;
+    dot = strrchr(name, '.');
+    if (dot && strcmp(dot, ".test") == 0) {
+        if (strncmp(name, "multi", 5) == 0) {
+            naddr = atoi(name + 5);
+            if (naddr > 64)
+                naddr = 64;
+            for (i = 0; i < naddr; i++)
+                addrs[i] = htonl(0x0a000001 + i);
+        } else if (alias) {
+            int l = sprintf((char *)cname + 1, "h%d", atoi(name + 5));
+
+            cname[0] = l;
+            memcpy(cname + l + 1, "\4test", 6);
+            p = add_rr(p, 5, cname, l + 7);
+            naddr = 1;
+            addrs[0] = htonl(0x7f000000 | (atoi(name + 5) & 0xff));
+        } else if (strncmp(name, "stray", 5) == 0) {
+            p = add_evil(p);
+            evil = 1;
+            naddr = 1;
+            addrs[0] = htonl(0x7f000000 | (atoi(name + 5) & 0xff));
+        } else if (strncmp(name, "lure", 4) == 0) {
+            p = add_evil(p);
+            evil = 1;
+        } else if (strncmp(name, "fail", 4) == 0) {
+            rcode = 2;
+        } else if (name[0] == 'h' && isdigit(name[1])) {
+            naddr = 1;
+            addrs[0] = htonl(0x7f000000 | (atoi(name + 1) & 0xff));
+        } else {
+            rcode = 3;
+        }
+    } else {
+        rcode = 3;
+    }
+    for (i = 0; i < naddr && p + 16 <= r->msg + sizeof(r->msg); i++) {
+        unsigned char *rr = p;
+
+        p = add_rr(p, 1, &addrs[i], 4);
+        /* owner is the CNAME target, the first answer's data */
+        if (alias)
+            put16(rr, 0xc000 | (qend - q + 12));
+    }
+    r->msg[3] |= rcode;
+    put16(r->msg + 6, alias + evil + i);
+    return p - r->msg;
+}
+
+static void *stub_main(void *arg)
+{
+    for (;;) {
+        struct pollfd pfd = { stub_fd, POLLIN, 0 };
+        double now = stub_ms(), next = now + 100;
+        int i;
+
+        for (i = 0; i < npending; i++) {
+            if (pending[i].due < next)
+                next = pending[i].due;
+        }
+        poll(&pfd, 1, next > now ? (int)(next - now) + 1 : 0);
+        if (pfd.revents & POLLIN) {
+            unsigned char q[512];
+            struct sockaddr_in from;
+            socklen_t fl = sizeof(from);
+            int len = recvfrom(stub_fd, q, sizeof(q), 0,
+                    (struct sockaddr *)&from, &fl);
+            struct reply *r = &pending[npending];
+
+            if (len >= 2)
+                host_dns.ids[host_dns.queries % 8] = (q[0] << 8) | q[1];
+            __atomic_add_fetch(&host_dns.queries, 1, __ATOMIC_RELAXED);
+            if (len > 0 && __atomic_load_n(&host_dns.drop, __ATOMIC_RELAXED)) {
+                __atomic_sub_fetch(&host_dns.drop, 1, __ATOMIC_RELAXED);
+            } else if (len > 0 && npending < PENDING &&
+                    (r->len = answer(r, q, len))) {
+                r->to = from;
+                r->due = stub_ms() + host_dns.delay;
+                npending++;
+            }
+        }
+        now = stub_ms();
+        for (i = 0; i < npending; ) {
+            if (pending[i].due > now) {
+                i++;
+                continue;
+            }
+            sendto(stub_fd, pending[i].msg, pending[i].len, 0,
+                    (struct sockaddr *)&pending[i].to,
+                    sizeof(pending[i].to));
+            pending[i] = pending[--npending];
+        }
+    }
+    return arg;
+}
+
+int host_dns_start(void)
+{
+    struct sockaddr_in sin;
+    socklen_t len = sizeof(sin);
+    pthread_t t;
+
+    if (stub_fd >= 0)
+        goto out;
+    stub_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (stub_fd < 0 || bind(stub_fd, (struct sockaddr *)&sin, sizeof(sin)))
+        return 0;
+    pthread_create(&t, NULL, stub_main, NULL);
+    pthread_detach(t);
+out:
+    getsockname(stub_fd, (struct sockaddr *)&sin, &len);
+    return ntohs(sin.sin_port);
+}
@@ -0,0 +1,94 @@
+/*
+ *  Open Winsock - host build glue between the shims and the test programs
+ *  Copyright (C) 2025  @stsp
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HOST_H
+#define HOST_H
+
+struct host_counters {
+    unsigned long posts;        /* PostMessage() calls */
+    unsigned long peeks;        /* PeekMessage() calls */
+    unsigned long timers;       /* SetTimer() calls */
+    unsigned long windows;      /* live windows */
+    unsigned long windows_max;
+    unsigned long d2s_calls;    /* "host transitions" into libd2sock */
+    unsigned long selects;
+    unsigned long select_wakes; /* select() calls a socket woke up */
+    unsigned long hooks;        /* blocking hook invocations */
+    unsigned long resolves;     /* resolver round trips */
+};
+extern struct host_counters host_cnt;
+
+void host_set_task(HTASK task);
+void host_set_queue_limit(int limit);
+/* provided by the harness: deliver a message posted to an app window */
+void host_app_msg(const MSG *msg);
+HTASK host_wnd_task(HWND hwnd);
+/* nonzero if s is in blocking mode (no FIONBIO) */
+int host_sock_blocking(SOCKET s);
+/* cap what one send() takes, as a host with a nearly full window
+ * would; 0 for none */
+void host_set_send_limit(int limit);
+
+/* DLL entry points, and the winsock.c wrappers that winsock.def exports
+ * under the plain socket API names */
+BOOL LibMain(HINSTANCE hInstance, WORD wDataSegment, WORD wHeapSize,
+        LPSTR lpszCmdLine);
+int WEP(int nParameter);
+SOCKET ws_accept(SOCKET s, struct sockaddr *addr, int *addrlen);
+int ws_bind(SOCKET s, const struct sockaddr *addr, int namelen);
+int ws_connect(SOCKET s, const struct sockaddr *name, int namelen);
+int ws_getpeername(SOCKET s, struct sockaddr *name, int *namelen);
+int ws_getsockname(SOCKET s, struct sockaddr *name, int *namelen);
+int ws_getsockopt(SOCKET s, int level, int optname, char *optval,
+        int *optlen);
+int ws_recv(SOCKET s, char *buf, int len, int flags);
+int ws_recvfrom(SOCKET s, char *buf, int len, int flags,
+        struct sockaddr *from, int *fromlen);
+int ws_send(SOCKET s, const char *buf, int len, int flags);
+int ws_sendto(SOCKET s, const char *buf, int len, int flags,
+        const struct sockaddr *to, int tolen);
+int ws_closesocket(SOCKET s);
+int ws_shutdown(SOCKET s, int how);
+SOCKET ws_socket(int af, int type, int protocol);
+int ws_setsockopt(SOCKET s, int level, int optname, const char *optval,
+        int optlen);
+int ws_ioctlsocket(SOCKET s, long cmd, u_long *argp);
+int ws_select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
+        const struct timeval *timeout);
+struct hostent *ws_gethostbyname(const char *name);
+struct hostent *ws_gethostbyaddr(const char *addr, int len, int type);
+struct servent *ws_getservbyname(const char *name, const char *proto);
+struct servent *ws_getservbyport(int port, const char *proto);
+struct protoent *ws_getprotobyname(const char *name);
+struct protoent *ws_getprotobynumber(int number);
+
+/* Stub DNS server on 127.0.0.1 in a thread of its own, see dnsstub.c.
+ * Returns its port, 0 if it could not be started. */
+struct host_dns_stub {
+    int drop;                   /* queries left to ignore */
+    int delay;                  /* ms before each reply */
+    unsigned long queries;      /* queries received */
+    unsigned short ids[8];      /* query IDs, by queries % 8 */
+};
+extern struct host_dns_stub host_dns;
+int host_dns_start(void);
+
+/* pump the emulated message loop of the current task for ms */
+void host_pump(int ms);
+
+#endif
@@ -0,0 +1,32 @@
+/*
+ *  Open Winsock - host build shim of libd2sock's private interface
+ *  Copyright (C) 2025  @stsp
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HOST_D2SOCK_H
+#define HOST_D2SOCK_H
+
+void d2s_set_blocking_hook(int (*hook)(void *arg));
+void d2s_set_debug_hook(void (*hook)(const char *msg));
+void d2s_set_close_hook(int (*hook)(int s, void *arg));
+void d2s_set_blocking_arg(int s, void *arg);
+void d2s_set_close_arg(int s, void *arg);
+void *d2s_get_close_arg(int s);
+int aconnect(int s);
+struct ws_hostent *gethostbyname_ex(const char *name, void *arg);
+void freehostent(struct ws_hostent *he);
+
+#endif
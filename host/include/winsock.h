@@ -0,0 +1,469 @@
+/*
+ *  Open Winsock - host build shim
+ *  Copyright (C) 2025  @stsp
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Just enough of windows.h and winsock.h (v1.1) to compile winsock.c
+ * natively on linux. Win16 types keep their 16-bit widths where the
+ * DLL code depends on them (HANDLE, WORD), pointers are plain.
+ */
+
+#ifndef HOST_WINSOCK_H
+#define HOST_WINSOCK_H
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/select.h>
+#include <stdint.h>
+
+#define far
+#define near
+#define pascal
+#define FAR
+#define NEAR
+#define PASCAL
+#define CALLBACK
+#define WINAPI
+#define _export
+
+typedef int BOOL;
+typedef unsigned char BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef unsigned int UINT;
+typedef long LONG;
+typedef char *LPSTR;
+typedef const char *LPCSTR;
+typedef void *LPVOID;
+typedef uint16_t HANDLE;
+typedef HANDLE HTASK;
+typedef HANDLE HINSTANCE;
+typedef HANDLE HGLOBAL;
+typedef HANDLE HWND;
+typedef HANDLE HFILE;
+typedef UINT WPARAM;
+typedef long LPARAM;
+typedef long LRESULT;
+typedef int (*FARPROC)();
+typedef LRESULT (*WNDPROC)(HWND, UINT, WPARAM, LPARAM);
+
+#ifndef max
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+
+#define TRUE 1
+#define FALSE 0
+#define HFILE_ERROR ((HFILE)-1)
+#define OF_READ 0
+
+#define LOWORD(l) ((WORD)(DWORD)(l))
+#define HIWORD(l) ((WORD)((DWORD)(l) >> 16))
+#define MAKELONG(lo, hi) ((LONG)(((WORD)(lo)) | (((DWORD)(WORD)(hi)) << 16)))
+
+typedef struct tagMSG {
+    HWND hwnd;
+    UINT message;
+    WPARAM wParam;
+    LPARAM lParam;
+    DWORD time;
+} MSG;
+
+typedef struct tagWNDCLASS {
+    UINT style;
+    WNDPROC lpfnWndProc;
+    int cbClsExtra;
+    int cbWndExtra;
+    HINSTANCE hInstance;
+    HANDLE hIcon;
+    HANDLE hCursor;
+    HANDLE hbrBackground;
+    LPCSTR lpszMenuName;
+    LPCSTR lpszClassName;
+} WNDCLASS;
+
+#define WM_TIMER 0x0113
+#define WM_USER 0x0400
+#define PM_NOREMOVE 0
+#define PM_REMOVE 1
+#define WS_OVERLAPPEDWINDOW 0x00CF0000L
+#define CW_USEDEFAULT ((int)0x8000)
+
+#define GMEM_FIXED 0x0000
+#define GMEM_MOVEABLE 0x0002
+#define GMEM_ZEROINIT 0x0040
+#define GMEM_SHARE 0x2000
+#define GPTR (GMEM_FIXED | GMEM_ZEROINIT)
+
+BOOL RegisterClass(const WNDCLASS *wc);
+HWND CreateWindow(LPCSTR cls, LPCSTR name, DWORD style, int x, int y,
+        int w, int h, HWND parent, HANDLE menu, HINSTANCE inst, void *param);
+BOOL DestroyWindow(HWND hWnd);
+BOOL IsWindow(HWND hWnd);
+BOOL PostMessage(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam);
+BOOL PeekMessage(MSG *msg, HWND hWnd, UINT first, UINT last, UINT flags);
+BOOL GetMessage(MSG *msg, HWND hWnd, UINT first, UINT last);
+BOOL TranslateMessage(const MSG *msg);
+LRESULT DispatchMessage(const MSG *msg);
+LRESULT DefWindowProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam);
+LONG SetWindowLong(HWND hWnd, int idx, LONG val);
+LONG GetWindowLong(HWND hWnd, int idx);
+UINT SetTimer(HWND hWnd, UINT id, UINT elapse, FARPROC func);
+BOOL KillTimer(HWND hWnd, UINT id);
+HTASK GetCurrentTask(void);
+DWORD GetTickCount(void);
+UINT GetProfileInt(LPCSTR app, LPCSTR key, int def);
+int GetProfileString(LPCSTR app, LPCSTR key, LPCSTR def, LPSTR buf, int len);
+HGLOBAL GlobalAlloc(UINT flags, DWORD size);
+HGLOBAL GlobalReAlloc(HGLOBAL h, DWORD size, UINT flags);
+HGLOBAL GlobalFree(HGLOBAL h);
+void *GlobalLock(HGLOBAL h);
+BOOL GlobalUnlock(HGLOBAL h);
+HFILE _lcreat(LPCSTR path, int attr);
+HFILE _lopen(LPCSTR path, int mode);
+UINT _lread(HFILE f, void *buf, UINT len);
+UINT _lwrite(HFILE f, const void *buf, UINT len);
+HFILE _lclose(HFILE f);
+UINT GetWindowsDirectory(LPSTR buf, UINT len);
+
+/* ----------------------------------------------------------------- */
+
+typedef unsigned char u_char;
+typedef unsigned short u_short;
+typedef unsigned int u_int;
+typedef unsigned long u_long;
+typedef u_int SOCKET;
+
+#ifndef FD_SETSIZE
+#define FD_SETSIZE 64
+#endif
+
+/* winsock fd_set is a counted array, not a bitmap */
+typedef struct ws_fd_set {
+    u_int fd_count;
+    SOCKET fd_array[FD_SETSIZE];
+} ws_fd_set;
+
+#ifndef D2H_IMPL
+#undef FD_SET
+#undef FD_CLR
+#undef FD_ZERO
+#undef FD_ISSET
+#define fd_set ws_fd_set
+#endif
+
+#define WS_FD_CLR(fd, set) do { \
+    u_int __i; \
+    for (__i = 0; __i < ((ws_fd_set *)(set))->fd_count; __i++) { \
+        if (((ws_fd_set *)(set))->fd_array[__i] == (fd)) { \
+            while (__i < ((ws_fd_set *)(set))->fd_count - 1) { \
+                ((ws_fd_set *)(set))->fd_array[__i] = \
+                    ((ws_fd_set *)(set))->fd_array[__i + 1]; \
+                __i++; \
+            } \
+            ((ws_fd_set *)(set))->fd_count--; \
+            break; \
+        } \
+    } \
+} while (0)
+#define WS_FD_SET(fd, set) do { \
+    if (((ws_fd_set *)(set))->fd_count < FD_SETSIZE) \
+        ((ws_fd_set *)(set))->fd_array[((ws_fd_set *)(set))->fd_count++] = \
+                (fd); \
+} while (0)
+#define WS_FD_ZERO(set) (((ws_fd_set *)(set))->fd_count = 0)
+#define WS_FD_ISSET(fd, set) __WSAFDIsSet((SOCKET)(fd), (ws_fd_set *)(set))
+
+#ifndef D2H_IMPL
+#define FD_CLR WS_FD_CLR
+#define FD_SET WS_FD_SET
+#define FD_ZERO WS_FD_ZERO
+#define FD_ISSET WS_FD_ISSET
+#endif
+
+int __WSAFDIsSet(SOCKET s, ws_fd_set *pfds);
+
+#define WS_IOCPARM_MASK 0x7f
+#define WS_IOC_VOID 0x20000000
+#define WS_IOC_OUT 0x40000000
+#define WS_IOC_IN 0x80000000
+#define _IOR_WS(x, y, t) (WS_IOC_OUT | (((long)sizeof(t) & WS_IOCPARM_MASK) << 16) | ((x) << 8) | (y))
+#define _IOW_WS(x, y, t) (WS_IOC_IN | (((long)sizeof(t) & WS_IOCPARM_MASK) << 16) | ((x) << 8) | (y))
+#undef FIONREAD
+#undef FIONBIO
+#undef FIOASYNC
+#define FIONREAD _IOR_WS('f', 127, u_long)
+#define FIONBIO _IOW_WS('f', 126, u_long)
+#define FIOASYNC _IOW_WS('f', 125, u_long)
+
+struct ws_hostent {
+    char *h_name;
+    char **h_aliases;
+    short h_addrtype;
+    short h_length;
+    char **h_addr_list;
+};
+
+struct ws_servent {
+    char *s_name;
+    char **s_aliases;
+    short s_port;
+    char *s_proto;
+};
+
+struct ws_protoent {
+    char *p_name;
+    char **p_aliases;
+    short p_proto;
+};
+
+struct ws_in_addr {
+    u_long s_addr;
+};
+
+struct ws_sockaddr {
+    u_short sa_family;
+    char sa_data[14];
+};
+
+struct ws_sockaddr_in {
+    short sin_family;
+    u_short sin_port;
+    struct ws_in_addr sin_addr;
+    char sin_zero[8];
+};
+
+struct ws_linger {
+    u_short l_onoff;
+    u_short l_linger;
+};
+
+#ifndef D2H_IMPL
+#define hostent ws_hostent
+#define servent ws_servent
+#define protoent ws_protoent
+#define in_addr ws_in_addr
+#define sockaddr ws_sockaddr
+#define sockaddr_in ws_sockaddr_in
+#define linger ws_linger
+#define h_addr h_addr_list[0]
+#endif
+
+#define WSADESCRIPTION_LEN 256
+#define WSASYS_STATUS_LEN 128
+
+typedef struct WSAData {
+    WORD wVersion;
+    WORD wHighVersion;
+    char szDescription[WSADESCRIPTION_LEN + 1];
+    char szSystemStatus[WSASYS_STATUS_LEN + 1];
+    unsigned short iMaxSockets;
+    unsigned short iMaxUdpDg;
+    char *lpVendorInfo;
+} WSADATA;
+typedef WSADATA *LPWSADATA;
+
+#define INVALID_SOCKET (SOCKET)(~0)
+#define SOCKET_ERROR (-1)
+
+#ifndef D2H_IMPL
+#undef SOCK_STREAM
+#undef SOCK_DGRAM
+#define SOCK_STREAM 1
+#define SOCK_DGRAM 2
+#define SOCK_RAW 3
+#define AF_INET 2
+#define PF_INET AF_INET
+#define INADDR_ANY (u_long)0x00000000
+#define INADDR_NONE 0xffffffff
+#define MSG_OOB 0x1
+#define MSG_PEEK 0x2
+#define MSG_DONTROUTE 0x4
+#define SOL_SOCKET 0xffff
+#define SO_DEBUG 0x0001
+#define SO_ACCEPTCONN 0x0002
+#define SO_REUSEADDR 0x0004
+#define SO_KEEPALIVE 0x0008
+#define SO_DONTROUTE 0x0010
+#define SO_BROADCAST 0x0020
+#define SO_LINGER 0x0080
+#define SO_OOBINLINE 0x0100
+#define SO_SNDBUF 0x1001
+#define SO_RCVBUF 0x1002
+#define SO_ERROR 0x1007
+#define SO_TYPE 0x1008
+#define IPPROTO_IP 0
+#define IPPROTO_ICMP 1
+#define IPPROTO_TCP 6
+#define IPPROTO_UDP 17
+#define TCP_NODELAY 0x0001
+#endif
+
+#define MAXGETHOSTSTRUCT 1024
+
+#define FD_READ 0x01
+#define FD_WRITE 0x02
+#define FD_OOB 0x04
+#define FD_ACCEPT 0x08
+#define FD_CONNECT 0x10
+#define FD_CLOSE 0x20
+
+#define WSABASEERR 10000
+#define WSAEINTR (WSABASEERR+4)
+#define WSAEBADF (WSABASEERR+9)
+#define WSAEACCES (WSABASEERR+13)
+#define WSAEFAULT (WSABASEERR+14)
+#define WSAEINVAL (WSABASEERR+22)
+#define WSAEMFILE (WSABASEERR+24)
+#define WSAEWOULDBLOCK (WSABASEERR+35)
+#define WSAEINPROGRESS (WSABASEERR+36)
+#define WSAEALREADY (WSABASEERR+37)
+#define WSAENOTSOCK (WSABASEERR+38)
+#define WSAEDESTADDRREQ (WSABASEERR+39)
+#define WSAEMSGSIZE (WSABASEERR+40)
+#define WSAEPROTOTYPE (WSABASEERR+41)
+#define WSAENOPROTOOPT (WSABASEERR+42)
+#define WSAEPROTONOSUPPORT (WSABASEERR+43)
+#define WSAESOCKTNOSUPPORT (WSABASEERR+44)
+#define WSAEOPNOTSUPP (WSABASEERR+45)
+#define WSAEPFNOSUPPORT (WSABASEERR+46)
+#define WSAEAFNOSUPPORT (WSABASEERR+47)
+#define WSAEADDRINUSE (WSABASEERR+48)
+#define WSAEADDRNOTAVAIL (WSABASEERR+49)
+#define WSAENETDOWN (WSABASEERR+50)
+#define WSAENETUNREACH (WSABASEERR+51)
+#define WSAENETRESET (WSABASEERR+52)
+#define WSAECONNABORTED (WSABASEERR+53)
+#define WSAECONNRESET (WSABASEERR+54)
+#define WSAENOBUFS (WSABASEERR+55)
+#define WSAEISCONN (WSABASEERR+56)
+#define WSAENOTCONN (WSABASEERR+57)
+#define WSAESHUTDOWN (WSABASEERR+58)
+#define WSAETIMEDOUT (WSABASEERR+60)
+#define WSAECONNREFUSED (WSABASEERR+61)
+#define WSAEHOSTUNREACH (WSABASEERR+65)
+#define WSASYSNOTREADY (WSABASEERR+91)
+#define WSAVERNOTSUPPORTED (WSABASEERR+92)
+#define WSANOTINITIALISED (WSABASEERR+93)
+#define WSAHOST_NOT_FOUND (WSABASEERR+1001)
+#define WSATRY_AGAIN (WSABASEERR+1002)
+#define WSANO_RECOVERY (WSABASEERR+1003)
+#define WSANO_DATA (WSABASEERR+1004)
+#define WSANO_ADDRESS WSANO_DATA
+
+#define WSAMAKEASYNCREPLY(buflen, error) MAKELONG(buflen, error)
+#define WSAMAKESELECTREPLY(event, error) MAKELONG(event, error)
+#define WSAGETASYNCBUFLEN(lParam) LOWORD(lParam)
+#define WSAGETASYNCERROR(lParam) HIWORD(lParam)
+#define WSAGETSELECTEVENT(lParam) LOWORD(lParam)
+#define WSAGETSELECTERROR(lParam) HIWORD(lParam)
+
+/* libd2sock-provided socket API; renamed so they don't clash with libc */
+#ifndef D2H_IMPL
+#define accept d2h_accept
+#define bind d2h_bind
+#define closesocket d2h_closesocket
+#define connect d2h_connect
+#define getpeername d2h_getpeername
+#define getsockname d2h_getsockname
+#define getsockopt d2h_getsockopt
+#define htonl d2h_htonl
+#define htons d2h_htons
+#define inet_addr d2h_inet_addr
+#define inet_ntoa d2h_inet_ntoa
+#define ioctlsocket d2h_ioctlsocket
+#define listen d2h_listen
+#define ntohl d2h_ntohl
+#define ntohs d2h_ntohs
+#define recv d2h_recv
+#define recvfrom d2h_recvfrom
+#define select d2h_select
+#define send d2h_send
+#define sendto d2h_sendto
+#define setsockopt d2h_setsockopt
+#define shutdown d2h_shutdown
+#define socket d2h_socket
+#define gethostbyaddr d2h_gethostbyaddr
+#define gethostbyname d2h_gethostbyname
+#define gethostname d2h_gethostname
+#define getservbyname d2h_getservbyname
+#define getservbyport d2h_getservbyport
+#define getprotobyname d2h_getprotobyname
+#define getprotobynumber d2h_getprotobynumber
+#endif
+
+SOCKET d2h_accept(SOCKET s, struct ws_sockaddr *addr, int *addrlen);
+int d2h_bind(SOCKET s, const struct ws_sockaddr *addr, int namelen);
+int d2h_closesocket(SOCKET s);
+int d2h_connect(SOCKET s, const struct ws_sockaddr *name, int namelen);
+int d2h_getpeername(SOCKET s, struct ws_sockaddr *name, int *namelen);
+int d2h_getsockname(SOCKET s, struct ws_sockaddr *name, int *namelen);
+int d2h_getsockopt(SOCKET s, int level, int optname, char *optval,
+        int *optlen);
+u_long d2h_htonl(u_long hostlong);
+u_short d2h_htons(u_short hostshort);
+unsigned long d2h_inet_addr(const char *cp);
+char *d2h_inet_ntoa(struct ws_in_addr in);
+int d2h_ioctlsocket(SOCKET s, long cmd, u_long *argp);
+int d2h_listen(SOCKET s, int backlog);
+u_long d2h_ntohl(u_long netlong);
+u_short d2h_ntohs(u_short netshort);
+int d2h_recv(SOCKET s, char *buf, int len, int flags);
+int d2h_recvfrom(SOCKET s, char *buf, int len, int flags,
+        struct ws_sockaddr *from, int *fromlen);
+int d2h_select(int nfds, ws_fd_set *readfds, ws_fd_set *writefds,
+        ws_fd_set *exceptfds, const struct timeval *timeout);
+int d2h_send(SOCKET s, const char *buf, int len, int flags);
+int d2h_sendto(SOCKET s, const char *buf, int len, int flags,
+        const struct ws_sockaddr *to, int tolen);
+int d2h_setsockopt(SOCKET s, int level, int optname, const char *optval,
+        int optlen);
+int d2h_shutdown(SOCKET s, int how);
+SOCKET d2h_socket(int af, int type, int protocol);
+struct ws_hostent *d2h_gethostbyaddr(const char *addr, int len, int type);
+struct ws_hostent *d2h_gethostbyname(const char *name);
+int d2h_gethostname(char *name, int namelen);
+struct ws_servent *d2h_getservbyname(const char *name, const char *proto);
+struct ws_servent *d2h_getservbyport(int port, const char *proto);
+struct ws_protoent *d2h_getprotobyname(const char *name);
+struct ws_protoent *d2h_getprotobynumber(int proto);
+
+/* Windows Sockets extensions, implemented by winsock.c */
+int WSAStartup(WORD wVersionRequired, LPWSADATA lpWSAData);
+int WSACleanup(void);
+void WSASetLastError(int iError);
+int WSAGetLastError(void);
+BOOL WSAIsBlocking(void);
+int WSAUnhookBlockingHook(void);
+FARPROC WSASetBlockingHook(FARPROC lpBlockFunc);
+int WSACancelBlockingCall(void);
+HANDLE WSAAsyncGetServByName(HWND hWnd, u_int wMsg, const char *name,
+        const char *proto, char *buf, int buflen);
+HANDLE WSAAsyncGetServByPort(HWND hWnd, u_int wMsg, int port,
+        const char *proto, char *buf, int buflen);
+HANDLE WSAAsyncGetProtoByName(HWND hWnd, u_int wMsg, const char *name,
+        char *buf, int buflen);
+HANDLE WSAAsyncGetProtoByNumber(HWND hWnd, u_int wMsg, int number,
+        char *buf, int buflen);
+HANDLE WSAAsyncGetHostByName(HWND hWnd, u_int wMsg, const char *name,
+        char *buf, int buflen);
+HANDLE WSAAsyncGetHostByAddr(HWND hWnd, u_int wMsg, const char *addr,
+        int len, int type, char *buf, int buflen);
+int WSACancelAsyncRequest(HANDLE hAsyncTaskHandle);
+int WSAAsyncSelect(SOCKET s, HWND hWnd, u_int wMsg, long lEvent);
+
+#endif
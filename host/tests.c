@@ -0,0 +1,1522 @@
+/*
+ *  Open Winsock - host build tests
+ *  Copyright (C) 2025  @stsp
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <winsock.h>
+#include "owinsock.h"
+#include "host.h"
+
+#define APPWND 1000
+#define APPWND2 1001            /* window of a second app, task 2 */
+#define WM_SOCK (WM_USER + 1)
+#define WM_HOST (WM_USER + 2)
+#define WM_CANCEL (WM_USER + 3)     /* cancels cancel_h when dispatched */
+#define WM_CLEANUP (WM_USER + 4)    /* WSACleanup() when dispatched */
+#define WM_BLOCK (WM_USER + 5)      /* a blocking lookup with app_hook() */
+
+static MSG got[256];
+static int ngot;
+static int failed;
+static HANDLE cancel_h;
+static int app_hooks, block_ok;
+static SOCKET hook_sock = INVALID_SOCKET;   /* app_hook() selects on it */
+static SOCKET hook_close = INVALID_SOCKET;  /* app_hook() closes it */
+
+#define CHECK(c) do { \
+    if (!(c)) { \
+        printf("%s:%d: %s: check failed: %s\n", __FILE__, __LINE__, \
+                __func__, #c); \
+        failed++; \
+    } \
+} while (0)
+
+static int app_hook(void)
+{
+    struct timeval tv = {0};
+    fd_set rd;
+
+    app_hooks++;
+    if (hook_close != INVALID_SOCKET) {
+        ws_closesocket(hook_close);
+        hook_close = INVALID_SOCKET;
+    }
+    if (hook_sock != INVALID_SOCKET) {
+        FD_ZERO(&rd);
+        FD_SET(hook_sock, &rd);
+        block_ok = ws_select(0, &rd, NULL, NULL, &tv) == 1;
+    }
+    return FALSE;
+}
+
+void host_app_msg(const MSG *msg)
+{
+    if (msg->message == WM_CANCEL) {
+        WSACancelAsyncRequest(cancel_h);
+        return;
+    }
+    if (msg->message == WM_CLEANUP) {
+        WSACleanup();
+        return;
+    }
+    if (msg->message == WM_BLOCK) {
+        WSASetBlockingHook(app_hook);
+        block_ok = ws_gethostbyname("h14.test") != NULL;
+        WSAUnhookBlockingHook();
+        return;
+    }
+    if (ngot < 256)
+        got[ngot++] = *msg;
+}
+
+HTASK host_wnd_task(HWND hwnd)
+{
+    return hwnd == APPWND2 ? 2 : 1;
+}
+
+static int count_msgs(UINT msg, long event)
+{
+    int i, n = 0;
+
+    for (i = 0; i < ngot; i++) {
+        if (got[i].message == msg &&
+                (!event || WSAGETSELECTEVENT(got[i].lParam) == event))
+            n++;
+    }
+    return n;
+}
+
+static SOCKET tcp_listen(struct sockaddr_in *sin)
+{
+    SOCKET l = socket(AF_INET, SOCK_STREAM, 0);
+    int len = sizeof(*sin);
+
+    memset(sin, 0, sizeof(*sin));
+    sin->sin_family = AF_INET;
+    sin->sin_addr.s_addr = htonl(0x7f000001);
+    bind(l, (struct sockaddr *)sin, sizeof(*sin));
+    listen(l, 5);
+    getsockname(l, (struct sockaddr *)sin, &len);
+    return l;
+}
+
+static void tcp_pair(SOCKET *c, SOCKET *a)
+{
+    struct sockaddr_in sin;
+    SOCKET l = tcp_listen(&sin);
+
+    *c = socket(AF_INET, SOCK_STREAM, 0);
+    connect(*c, (struct sockaddr *)&sin, sizeof(sin));
+    *a = accept(l, NULL, NULL);
+    closesocket(l);
+}
+
+static void test_async_select(void)
+{
+    SOCKET c, a;
+    char buf[8];
+
+    tcp_pair(&c, &a);
+    ngot = 0;
+    CHECK(WSAAsyncSelect(a, APPWND, WM_SOCK, FD_READ | FD_CLOSE) == 0);
+    host_pump(30);
+    CHECK(ngot == 0);
+    send(c, "hello", 5, 0);
+    host_pump(200);
+    CHECK(count_msgs(WM_SOCK, FD_READ) == 1);
+    CHECK(ngot && got[0].wParam == a);
+
+    /* data left after recv(): FD_READ again, without re-registering */
+    ngot = 0;
+    CHECK(ws_recv(a, buf, 2, 0) == 2);
+    host_pump(200);
+    CHECK(count_msgs(WM_SOCK, FD_READ) == 1);
+    ngot = 0;
+    CHECK(ws_recv(a, buf, sizeof(buf), 0) == 3);
+    host_pump(200);
+    CHECK(ngot == 0);
+    send(c, "again", 5, 0);
+    host_pump(200);
+    CHECK(count_msgs(WM_SOCK, FD_READ) == 1);
+    CHECK(host_cnt.windows == 1);
+
+    WSAAsyncSelect(a, APPWND, 0, 0);
+    ws_closesocket(a);
+    closesocket(c);
+}
+
+static void test_accept(void)
+{
+    struct sockaddr_in sin;
+    SOCKET l = tcp_listen(&sin);
+    SOCKET c[3], a;
+    int i, n = 0;
+
+    ngot = 0;
+    CHECK(WSAAsyncSelect(l, APPWND, WM_SOCK, FD_ACCEPT) == 0);
+    for (i = 0; i < 3; i++) {
+        c[i] = socket(AF_INET, SOCK_STREAM, 0);
+        connect(c[i], (struct sockaddr *)&sin, sizeof(sin));
+    }
+    for (i = 0; i < 20 && n < 3; i++) {
+        host_pump(60);
+        if (count_msgs(WM_SOCK, FD_ACCEPT)) {
+            ngot = 0;
+            a = ws_accept(l, NULL, NULL);
+            CHECK(a != INVALID_SOCKET);
+            closesocket(a);
+            n++;
+        }
+    }
+    CHECK(n == 3);
+    host_pump(200);
+    CHECK(ngot == 0);
+    WSAAsyncSelect(l, APPWND, 0, 0);
+    for (i = 0; i < 3; i++)
+        closesocket(c[i]);
+    closesocket(l);
+}
+
+/* Past iMaxSockets host descriptors are refused, so any socket the
+ * app has can be registered. */
+static void test_max_sockets(void)
+{
+    struct sockaddr_in sin;
+    SOCKET l = tcp_listen(&sin);
+    SOCKET c = socket(AF_INET, SOCK_STREAM, 0);
+    static char taken[1024];
+    WSADATA d;
+    int fd;
+
+    CHECK(WSAStartup(0x0101, &d) == 0);
+    connect(c, (struct sockaddr *)&sin, sizeof(sin));
+    /* take the rest of the descriptors the DLL has room for */
+    while ((fd = dup(l)) >= 0 && fd < 1024) {
+        taken[fd] = 1;
+        if (fd >= d.iMaxSockets - 1)
+            break;
+    }
+    CHECK(fd == d.iMaxSockets - 1);
+    CHECK(WSAAsyncSelect(fd, APPWND, WM_SOCK, FD_READ) == 0);
+    WSAAsyncSelect(fd, APPWND, 0, 0);
+    CHECK(ws_socket(AF_INET, SOCK_STREAM, 0) == INVALID_SOCKET &&
+            WSAGetLastError() == WSAEMFILE);
+    usleep(10000);
+    CHECK(ws_accept(l, NULL, NULL) == INVALID_SOCKET &&
+            WSAGetLastError() == WSAEMFILE);
+    for (fd = 0; fd < 1024; fd++) {
+        if (taken[fd])
+            close(fd);
+    }
+    WSACleanup();
+    closesocket(c);
+    closesocket(l);
+}
+
+/* a blocking recv() sleeps on the socket instead of spinning the hook */
+static void test_blocking_wait(void)
+{
+    SOCKET c, a;
+    DWORD t0, t;
+    unsigned long hooks, wakes;
+    char b;
+    pid_t pid;
+    int i;
+
+    tcp_pair(&c, &a);
+    pid = fork();
+    if (!pid) {
+        usleep(100000);
+        write(c, "x", 1);
+        _exit(0);
+    }
+    hooks = host_cnt.hooks;
+    t0 = GetTickCount();
+    CHECK(ws_recv(a, &b, 1, 0) == 1);
+    t = GetTickCount() - t0;
+    waitpid(pid, NULL, 0);
+    /* slept in between, didn't spin the hook */
+    CHECK(t >= 90);
+    CHECK(host_cnt.hooks - hooks < 20);
+
+    /* woken by the data, not by the next BlockWait timeout */
+    wakes = host_cnt.select_wakes;
+    for (i = 0; i < 4; i++) {
+        pid = fork();
+        if (!pid) {
+            usleep(30000 + i * 7000);
+            write(c, "x", 1);
+            _exit(0);
+        }
+        CHECK(ws_recv(a, &b, 1, 0) == 1);
+        waitpid(pid, NULL, 0);
+    }
+    CHECK(host_cnt.select_wakes - wakes >= 4);
+    ws_closesocket(a);
+    closesocket(c);
+}
+
+/* a new registration takes over the socket's state from the cancelled
+ * one still waiting in the dispatcher queue */
+static void test_reregister(void)
+{
+    SOCKET c, a;
+    char buf[8];
+
+    tcp_pair(&c, &a);
+    ngot = 0;
+    CHECK(WSAAsyncSelect(a, APPWND, WM_SOCK, FD_WRITE) == 0);
+    CHECK(WSAAsyncSelect(a, APPWND, WM_SOCK, FD_READ) == 0);
+    host_pump(100);
+    CHECK(ngot == 0);
+    send(c, "x", 1, 0);
+    host_pump(200);
+    CHECK(ngot == 1 && count_msgs(WM_SOCK, FD_READ) == 1);
+    CHECK(ws_recv(a, buf, sizeof(buf), 0) == 1);
+    WSAAsyncSelect(a, APPWND, 0, 0);
+    ws_closesocket(a);
+    closesocket(c);
+}
+
+/* WSACleanup() closes what the task left open */
+static void test_cleanup(void)
+{
+    WSADATA d;
+    SOCKET s = ws_socket(AF_INET, SOCK_STREAM, 0);
+    SOCKET u = ws_socket(AF_INET, SOCK_DGRAM, 0);
+
+    CHECK(s != INVALID_SOCKET && u != INVALID_SOCKET);
+    CHECK(WSAAsyncSelect(u, APPWND, WM_SOCK, FD_READ) == 0);
+    WSACleanup();
+    CHECK(fcntl(s, F_GETFD) == -1 && fcntl(u, F_GETFD) == -1);
+    /* one too many, with a stale error about */
+    errno = EAGAIN;
+    CHECK(WSACleanup() == SOCKET_ERROR);
+    CHECK(WSAGetLastError() == WSANOTINITIALISED);
+    CHECK(WSAStartup(0x0101, &d) == 0);
+}
+
+/* WSACleanup() while a lookup waits in its blocking hook: the task
+ * lives on until the lookup is off the stack */
+static void test_cleanup_nested(void)
+{
+    static char buf[MAXGETHOSTSTRUCT];
+    unsigned long windows = host_cnt.windows;
+    WSADATA d;
+
+    host_set_task(2);
+    CHECK(WSAStartup(0x0101, &d) == 0);
+    ngot = 0;
+    setenv("OWS_HOST_DNS_DELAY", "100", 1);
+    CHECK(WSAAsyncGetHostByName(APPWND2, WM_HOST, "h12.test", buf,
+            sizeof(buf)) != 0);
+    CHECK(host_cnt.windows == windows + 1);
+    PostMessage(APPWND2, WM_CLEANUP, 0, 0);
+    host_pump(300);
+    unsetenv("OWS_HOST_DNS_DELAY");
+    CHECK(count_msgs(WM_HOST, 0) == 0);
+    CHECK(host_cnt.windows == windows);
+
+    /* and the task can start over */
+    CHECK(WSAStartup(0x0101, &d) == 0);
+    CHECK(WSAAsyncGetHostByName(APPWND2, WM_HOST, "h12.test", buf,
+            sizeof(buf)) != 0);
+    host_pump(50);
+    CHECK(count_msgs(WM_HOST, 0) == 1);
+    WSACleanup();
+    CHECK(host_cnt.windows == windows);
+    host_set_task(1);
+}
+
+/* queries are answered from memory until something changes them */
+static void test_query_cache(void)
+{
+    struct sockaddr_in sin, peer;
+    unsigned long calls;
+    SOCKET c, a;
+    u_long n, nb = 1;
+    int v, len;
+    char buf[8];
+
+    tcp_pair(&c, &a);
+    len = sizeof(peer);
+    CHECK(ws_getpeername(a, (struct sockaddr *)&peer, &len) == 0);
+    len = sizeof(sin);
+    CHECK(ws_getsockname(a, (struct sockaddr *)&sin, &len) == 0);
+    len = sizeof(v);
+    CHECK(ws_getsockopt(a, SOL_SOCKET, SO_KEEPALIVE, (char *)&v, &len) == 0);
+    CHECK(v == 0);
+    calls = host_cnt.d2s_calls;
+    len = sizeof(sin);
+
+    CHECK(ws_getpeername(a, (struct sockaddr *)&sin, &len) == 0 &&
+            sin.sin_port == peer.sin_port);
+    len = sizeof(sin);
+    CHECK(ws_getsockname(a, (struct sockaddr *)&sin, &len) == 0);
+    len = sizeof(v);
+    CHECK(ws_getsockopt(a, SOL_SOCKET, SO_KEEPALIVE, (char *)&v, &len) == 0);
+    CHECK(host_cnt.d2s_calls == calls);
+
+    /* setting an option reads it back from the host */
+    v = 1;
+    CHECK(ws_setsockopt(a, SOL_SOCKET, SO_KEEPALIVE, (char *)&v,
+            sizeof(v)) == 0);
+    v = 0;
+    len = sizeof(v);
+    calls = host_cnt.d2s_calls;
+    CHECK(ws_getsockopt(a, SOL_SOCKET, SO_KEEPALIVE, (char *)&v, &len) == 0);
+    CHECK(v != 0 && host_cnt.d2s_calls - calls == 1);
+
+    /* FIONREAD until recv() or the TTL */
+    send(c, "hello", 5, 0);
+    usleep(10000);
+    CHECK(ws_ioctlsocket(a, FIONREAD, &n) == 0 && n == 5);
+    send(c, "!", 1, 0);
+    usleep(10000);
+    calls = host_cnt.d2s_calls;
+    CHECK(ws_ioctlsocket(a, FIONREAD, &n) == 0 && n == 5);
+    CHECK(host_cnt.d2s_calls == calls);
+    usleep(60000);
+    CHECK(ws_ioctlsocket(a, FIONREAD, &n) == 0 && n == 6);
+    CHECK(ws_recv(a, buf, 6, 0) == 6);
+    CHECK(ws_ioctlsocket(a, FIONREAD, &n) == 0 && n == 0);
+
+    /* the peer going away drops the peer address */
+    closesocket(c);
+    usleep(10000);
+    CHECK(ws_recv(a, buf, sizeof(buf), 0) == 0);
+    len = sizeof(sin);
+    calls = host_cnt.d2s_calls;
+    ws_getpeername(a, (struct sockaddr *)&sin, &len);
+    CHECK(host_cnt.d2s_calls - calls == 1);
+
+    /* FIONBIO to the mode the socket has is not passed on */
+    ws_closesocket(a);
+    a = ws_socket(AF_INET, SOCK_STREAM, 0);
+    nb = 0;
+    calls = host_cnt.d2s_calls;
+    CHECK(ws_ioctlsocket(a, FIONBIO, &nb) == 0);
+    CHECK(host_cnt.d2s_calls == calls);
+    nb = 1;
+    CHECK(ws_ioctlsocket(a, FIONBIO, &nb) == 0);
+    CHECK(ws_ioctlsocket(a, FIONBIO, &nb) == 0);
+    CHECK(host_cnt.d2s_calls - calls == 1);
+    ws_closesocket(a);
+}
+
+/* a full app queue delays the event instead of losing it */
+static void test_post_fail(void)
+{
+    struct ows_task_stats ts;
+    SOCKET c, a;
+    char buf[4];
+
+    tcp_pair(&c, &a);
+    send(c, "x", 1, 0);
+    ngot = 0;
+    /* a message for the other task that nobody takes fills the queue */
+    PostMessage(APPWND2, WM_SOCK, 0, 0);
+    host_set_queue_limit(1);
+    CHECK(WSAAsyncSelect(a, APPWND, WM_SOCK, FD_READ) == 0);
+    host_pump(200);
+    CHECK(ngot == 0);
+    CHECK(OWSGetTaskStats(0, &ts) == 0 && ts.post_fails > 0);
+    host_set_queue_limit(0);
+    host_pump(200);
+    CHECK(count_msgs(WM_SOCK, FD_READ) == 1);
+    CHECK(ws_recv(a, buf, sizeof(buf), 0) == 1);
+    WSAAsyncSelect(a, APPWND, 0, 0);
+    ws_closesocket(a);
+    closesocket(c);
+    host_set_task(2);
+    host_pump(1);
+    host_set_task(1);
+}
+
+/* dispatch the current task's messages up to its first dispatcher run
+ * that posts, returns what that run posted */
+static unsigned long pump_first_posts(void)
+{
+    struct ows_task_stats ts;
+    MSG m;
+    int i;
+
+    for (i = 0; i < 1000; i++) {
+        if (OWSGetTaskStats(0, &ts) == 0 && ts.posts)
+            break;
+        if (PeekMessage(&m, 0, 0, 0, PM_REMOVE))
+            DispatchMessage(&m);
+        else
+            usleep(1000);
+    }
+    return ts.posts;
+}
+
+/* Over its share of the event budget a task leaves the rest to the
+ * timer while another task has events of its own, and each socket is
+ * served in turn. A task with idle registrations only doesn't count. */
+#define FAIR_N 40
+static void test_fairness(void)
+{
+    SOCKET c[FAIR_N], a[FAIR_N], lc, la;
+    struct ows_task_stats ts;
+    WSADATA d;
+    int i, seen[FAIR_N] = {0};
+    char b;
+
+    host_set_task(2);
+    CHECK(WSAStartup(0x0101, &d) == 0);
+    tcp_pair(&lc, &la);
+    CHECK(WSAAsyncSelect(la, APPWND2, WM_SOCK, FD_READ) == 0);
+    host_pump(10);
+    host_set_task(1);
+
+    for (i = 0; i < FAIR_N; i++) {
+        tcp_pair(&c[i], &a[i]);
+        send(c[i], "x", 1, 0);
+    }
+    usleep(10000);
+    OWSResetStats();
+    ngot = 0;
+    for (i = 0; i < FAIR_N; i++)
+        WSAAsyncSelect(a[i], APPWND, WM_SOCK, FD_READ);
+    /* the other task is idle: the whole budget */
+    CHECK(pump_first_posts() == 32);
+    host_pump(100);
+    CHECK(count_msgs(WM_SOCK, FD_READ) == FAIR_N);
+
+    /* the other task posts too, stopped right after: it has a share */
+    host_set_task(2);
+    send(lc, "x", 1, 0);
+    CHECK(pump_first_posts() == 1);
+    host_set_task(1);
+    for (i = 0; i < FAIR_N; i++) {
+        CHECK(ws_recv(a[i], &b, 1, 0) == 1);
+        send(c[i], "y", 1, 0);
+    }
+    usleep(10000);
+    OWSResetStats();
+    ngot = 0;
+    /* half of the budget */
+    CHECK(pump_first_posts() == 16);
+    host_pump(300);
+    CHECK(count_msgs(WM_SOCK, FD_READ) == FAIR_N);
+    for (i = 0; i < ngot; i++) {
+        int j;
+
+        for (j = 0; j < FAIR_N; j++) {
+            if (got[i].wParam == a[j])
+                seen[j]++;
+        }
+    }
+    for (i = 0; i < FAIR_N && seen[i] == 1; i++);
+    CHECK(i == FAIR_N);
+    CHECK(OWSGetTaskStats(0, &ts) == 0);
+    CHECK(ts.posts == FAIR_N && ts.deferred >= 2);
+
+    for (i = 0; i < FAIR_N; i++) {
+        WSAAsyncSelect(a[i], APPWND, 0, 0);
+        ws_closesocket(a[i]);
+        closesocket(c[i]);
+    }
+    host_set_task(2);
+    WSAAsyncSelect(la, APPWND2, 0, 0);
+    ws_closesocket(la);
+    closesocket(lc);
+    WSACleanup();
+    host_set_task(1);
+}
+
+static SOCKET udp_bound(struct sockaddr_in *sin)
+{
+    SOCKET u = socket(AF_INET, SOCK_DGRAM, 0);
+    int len = sizeof(*sin);
+
+    memset(sin, 0, sizeof(*sin));
+    sin->sin_family = AF_INET;
+    sin->sin_addr.s_addr = htonl(0x7f000001);
+    bind(u, (struct sockaddr *)sin, sizeof(*sin));
+    getsockname(u, (struct sockaddr *)sin, &len);
+    return u;
+}
+
+static void test_vectored(void)
+{
+    static char big[10000], out[10020];
+    char h[4], b[10], t[2];
+    struct ows_buf v[3] = { { "HEAD", 4 }, { "0123456789", 10 }, { "!!", 2 } };
+    struct ows_buf r[3] = { { h, 4 }, { b, 10 }, { t, 2 } };
+    struct sockaddr_in usin, csin;
+    unsigned long calls;
+    SOCKET c, a;
+    int n, got_len, on = 1;
+
+    tcp_pair(&c, &a);
+    /* no write combining, each OWSSendV() goes out by itself */
+    CHECK(ws_setsockopt(a, IPPROTO_TCP, TCP_NODELAY, (char *)&on,
+            sizeof(on)) == 0);
+    calls = host_cnt.d2s_calls;
+    CHECK(OWSSendV(a, v, 3, 0) == 16);
+    CHECK(host_cnt.d2s_calls - calls == 1);
+    calls = host_cnt.d2s_calls;
+    CHECK(OWSRecvV(c, r, 3, 0) == 16);
+    /* plus the read-ahead SO_TYPE check on first use */
+    CHECK(host_cnt.d2s_calls - calls == 2);
+    CHECK(memcmp(h, "HEAD", 4) == 0 && memcmp(b, "0123456789", 10) == 0 &&
+            memcmp(t, "!!", 2) == 0);
+
+    /* a piece bigger than the bounce buffer goes out as is */
+    memset(big, 'x', sizeof(big));
+    v[1].buf = big;
+    v[1].len = sizeof(big);
+    n = OWSSendV(a, v, 3, 0);
+    CHECK(n == 4 + sizeof(big) + 2);
+    for (got_len = 0; got_len < n; ) {
+        int k = recv(c, out + got_len, sizeof(out) - got_len, 0);
+
+        if (k <= 0)
+            break;
+        got_len += k;
+    }
+    CHECK(got_len == n && memcmp(out, "HEAD", 4) == 0 &&
+            out[4 + sizeof(big)] == '!');
+
+    v[1].len = -1;
+    CHECK(OWSSendV(a, v, 3, 0) == SOCKET_ERROR &&
+            WSAGetLastError() == WSAEINVAL);
+    r[1].len = -1;
+    CHECK(OWSRecvV(c, r, 3, 0) == SOCKET_ERROR &&
+            WSAGetLastError() == WSAEINVAL);
+    /* more than the int returned can count */
+    v[0].buf = v[1].buf = v[2].buf = big;
+    v[0].len = v[1].len = v[2].len = sizeof(big) + 1000;
+    CHECK(OWSSendV(a, v, 3, 0) == SOCKET_ERROR &&
+            WSAGetLastError() == WSAEINVAL);
+    ws_closesocket(a);
+    ws_closesocket(c);
+
+    /* a datagram over the bounce buffer only goes in one piece */
+    a = udp_bound(&usin);
+    c = udp_bound(&csin);
+    connect(a, (struct sockaddr *)&csin, sizeof(csin));
+    v[1].len = v[2].len = 0;
+    v[0].len = sizeof(big);
+    CHECK(OWSSendV(a, v, 3, 0) == sizeof(big));
+    CHECK(recv(c, out, sizeof(out), 0) == sizeof(big));
+    v[1].len = 1;
+    CHECK(OWSSendV(a, v, 3, 0) == SOCKET_ERROR &&
+            WSAGetLastError() == WSAEMSGSIZE);
+    ws_closesocket(a);
+    ws_closesocket(c);
+}
+
+/* byte-at-a-time reads are served from memory, and the data read
+ * ahead still shows in FIONREAD and select() */
+static void test_readahead(void)
+{
+    struct sockaddr_in sin;
+    struct timeval tv = {0};
+    unsigned long calls;
+    SOCKET c, a, u;
+    fd_set rd;
+    u_long n;
+    char buf[16];
+    int i, len = sizeof(sin);
+
+    tcp_pair(&c, &a);
+    send(c, "hello world", 11, 0);
+    usleep(10000);
+    calls = host_cnt.d2s_calls;
+    for (i = 0; i < 11; i++)
+        CHECK(ws_recv(a, buf + i, 1, 0) == 1);
+    CHECK(memcmp(buf, "hello world", 11) == 0);
+    /* SO_TYPE check and one fill */
+    CHECK(host_cnt.d2s_calls - calls == 2);
+
+    send(c, "abc", 3, 0);
+    usleep(10000);
+    CHECK(ws_recv(a, buf, 1, 0) == 1 && buf[0] == 'a');
+    CHECK(ws_ioctlsocket(a, FIONREAD, &n) == 0 && n == 2);
+    CHECK(ws_recv(a, buf, 1, MSG_PEEK) == 1 && buf[0] == 'b');
+    CHECK(ws_ioctlsocket(a, FIONREAD, &n) == 0 && n == 2);
+    FD_ZERO(&rd);
+    FD_SET(a, &rd);
+    CHECK(ws_select(0, &rd, NULL, NULL, &tv) == 1 && FD_ISSET(a, &rd));
+    CHECK(ws_recv(a, buf, sizeof(buf), 0) == 2 && buf[1] == 'c');
+    FD_SET(a, &rd);
+    CHECK(ws_select(0, &rd, NULL, NULL, &tv) == 0);
+
+    /* EOF comes after the data */
+    send(c, "z", 1, 0);
+    closesocket(c);
+    usleep(10000);
+    CHECK(ws_recv(a, buf, 4, 0) == 1 && buf[0] == 'z');
+    CHECK(ws_recv(a, buf, 4, 0) == 0);
+    ws_closesocket(a);
+
+    /* datagrams are never merged */
+    u = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(0x7f000001);
+    bind(u, (struct sockaddr *)&sin, sizeof(sin));
+    getsockname(u, (struct sockaddr *)&sin, &len);
+    sendto(u, "one", 3, 0, (struct sockaddr *)&sin, sizeof(sin));
+    sendto(u, "two", 3, 0, (struct sockaddr *)&sin, sizeof(sin));
+    usleep(10000);
+    CHECK(ws_recv(u, buf, 8, 0) == 3 && memcmp(buf, "one", 3) == 0);
+    CHECK(ws_recv(u, buf, 8, 0) == 3 && memcmp(buf, "two", 3) == 0);
+    ws_closesocket(u);
+}
+
+/* a select() from the blocking hook doesn't leak its read-ahead hits
+ * into the one waiting */
+static void test_select_nested(void)
+{
+    struct timeval tv = { 1, 0 };
+    SOCKET c, a, c2, a2;
+    char b;
+    fd_set rd;
+    pid_t pid;
+
+    tcp_pair(&c, &a);
+    tcp_pair(&c2, &a2);
+    send(c2, "ab", 2, 0);
+    usleep(10000);
+    CHECK(ws_recv(a2, &b, 1, 0) == 1);
+    hook_sock = a2;
+    app_hooks = block_ok = 0;
+    WSASetBlockingHook(app_hook);
+    pid = fork();
+    if (!pid) {
+        usleep(30000);
+        write(c, "x", 1);
+        _exit(0);
+    }
+    FD_ZERO(&rd);
+    FD_SET(a, &rd);
+    CHECK(ws_select(0, &rd, NULL, NULL, &tv) == 1);
+    CHECK(rd.fd_count == 1 && rd.fd_array[0] == a);
+    CHECK(app_hooks > 0 && block_ok);
+    waitpid(pid, NULL, 0);
+    WSAUnhookBlockingHook();
+    hook_sock = INVALID_SOCKET;
+    ws_closesocket(a);
+    ws_closesocket(a2);
+    closesocket(c);
+    closesocket(c2);
+}
+
+/* small sends go to the host together, on the next dispatcher run or
+ * before anything that must not overtake them */
+static void test_write_combine(void)
+{
+    static char big[2000];
+    struct timeval tv = {0};
+    unsigned long calls, sent, got_len;
+    struct linger lg;
+    u_long on = 1;
+    SOCKET c, a;
+    fd_set rd;
+    char buf[2100], last[4];
+    int i, n = 1;
+    DWORD t0;
+
+    tcp_pair(&c, &a);
+    ioctlsocket(c, FIONBIO, &on);
+    calls = host_cnt.d2s_calls;
+    for (i = 0; i < 10; i++)
+        CHECK(ws_send(a, "0123456789" + i, 1, 0) == 1);
+    /* only the SO_TYPE check */
+    CHECK(host_cnt.d2s_calls - calls == 1);
+    CHECK(recv(c, buf, sizeof(buf), 0) == SOCKET_ERROR);
+    host_pump(20);
+    usleep(10000);
+    CHECK(recv(c, buf, sizeof(buf), 0) == 10 &&
+            memcmp(buf, "0123456789", 10) == 0);
+
+    /* select() flushes, big sends go after what is buffered */
+    CHECK(ws_send(a, "ab", 2, 0) == 2);
+    FD_ZERO(&rd);
+    FD_SET(a, &rd);
+    CHECK(ws_select(0, &rd, NULL, NULL, &tv) == 0);
+    usleep(10000);
+    CHECK(recv(c, buf, sizeof(buf), 0) == 2 && buf[0] == 'a');
+    memset(big, 'B', sizeof(big));
+    CHECK(ws_send(a, "1", 1, 0) == 1);
+    CHECK(ws_send(a, big, sizeof(big), 0) == sizeof(big));
+    usleep(10000);
+    CHECK(recv(c, buf, sizeof(buf), 0) == 1 + sizeof(big) &&
+            buf[0] == '1' && buf[1] == 'B');
+
+    /* TCP_NODELAY sends right away */
+    CHECK(ws_send(a, "n", 1, 0) == 1);
+    CHECK(ws_setsockopt(a, IPPROTO_TCP, TCP_NODELAY, (char *)&n,
+            sizeof(n)) == 0);
+    CHECK(ws_send(a, "d", 1, 0) == 1);
+    usleep(10000);
+    CHECK(recv(c, buf, sizeof(buf), 0) == 2 && memcmp(buf, "nd", 2) == 0);
+    n = 0;
+    ws_setsockopt(a, IPPROTO_TCP, TCP_NODELAY, (char *)&n, sizeof(n));
+
+    /* closesocket() flushes */
+    CHECK(ws_send(a, "end", 3, 0) == 3);
+    CHECK(ws_closesocket(a) == 0);
+    usleep(10000);
+    CHECK(recv(c, buf, sizeof(buf), 0) == 3 && memcmp(buf, "end", 3) == 0);
+    CHECK(recv(c, buf, sizeof(buf), 0) == 0);
+    closesocket(c);
+
+    /* a failed deferred flush is reported by the next send() */
+    tcp_pair(&c, &a);
+    closesocket(c);
+    CHECK(ws_send(a, "x", 1, 0) == 1);
+    host_pump(20);
+    CHECK(ws_send(a, "y", 1, 0) == 1);
+    host_pump(20);
+    CHECK(ws_send(a, "z", 1, 0) == SOCKET_ERROR);
+    ws_closesocket(a);
+
+    /* Host buffers full: only a lingering close of a non-blocking socket
+     * fails, a graceful one sends the rest in the background. */
+    tcp_pair(&c, &a);
+    ioctlsocket(c, FIONBIO, &on);
+    CHECK(ws_ioctlsocket(a, FIONBIO, &on) == 0);
+    for (sent = 0; (n = ws_send(a, big, sizeof(big), 0)) > 0; sent += n);
+    CHECK(WSAGetLastError() == WSAEWOULDBLOCK);
+    CHECK(ws_send(a, "tail", 4, 0) == 4);
+    lg.l_onoff = 1;
+    lg.l_linger = 5;
+    CHECK(ws_setsockopt(a, SOL_SOCKET, SO_LINGER, (char *)&lg,
+            sizeof(lg)) == 0);
+    CHECK(ws_closesocket(a) == SOCKET_ERROR);
+    CHECK(WSAGetLastError() == WSAEWOULDBLOCK);
+    lg.l_onoff = 0;
+    ws_setsockopt(a, SOL_SOCKET, SO_LINGER, (char *)&lg, sizeof(lg));
+    CHECK(ws_closesocket(a) == 0);
+    t0 = GetTickCount();
+    for (got_len = 0; GetTickCount() - t0 < 3000; ) {
+        n = recv(c, buf, sizeof(buf), 0);
+        if (n == 0)
+            break;
+        if (n < 0) {
+            host_pump(5);
+            continue;
+        }
+        got_len += n;
+        if (n >= 4)
+            memcpy(last, buf + n - 4, 4);
+    }
+    CHECK(n == 0 && got_len == sent + 4 && memcmp(last, "tail", 4) == 0);
+    closesocket(c);
+
+    /* The host takes part of a flush: the rest would block, whatever
+     * error an earlier call left. A close sends it in the background. */
+    tcp_pair(&c, &a);
+    ioctlsocket(c, FIONBIO, &on);
+    CHECK(ws_ioctlsocket(a, FIONBIO, &on) == 0);
+    memset(buf, 'p', 100);
+    memcpy(buf + 96, "tail", 4);
+    CHECK(ws_send(a, buf, 100, 0) == 100);
+    host_set_send_limit(10);
+    n = sizeof(n);
+    CHECK(ws_getsockopt(a, SOL_SOCKET, 0x7777, (char *)&i, &n) ==
+            SOCKET_ERROR);
+    CHECK(ws_send(a, big, sizeof(big), 0) == SOCKET_ERROR &&
+            WSAGetLastError() == WSAEWOULDBLOCK);
+    CHECK(ws_getsockopt(a, SOL_SOCKET, 0x7777, (char *)&i, &n) ==
+            SOCKET_ERROR);
+    CHECK(ws_closesocket(a) == 0);
+    host_set_send_limit(0);
+    t0 = GetTickCount();
+    for (got_len = 0; GetTickCount() - t0 < 3000; ) {
+        n = recv(c, buf, sizeof(buf), 0);
+        if (n == 0)
+            break;
+        if (n < 0) {
+            host_pump(5);
+            continue;
+        }
+        got_len += n;
+        if (n >= 4)
+            memcpy(last, buf + n - 4, 4);
+    }
+    CHECK(n == 0 && got_len == 100 && memcmp(last, "tail", 4) == 0);
+    closesocket(c);
+
+    /* closed from the hook while a send() waits to flush it */
+    tcp_pair(&c, &a);
+    CHECK(ws_ioctlsocket(a, FIONBIO, &on) == 0);
+    while (ws_send(a, big, sizeof(big), 0) > 0);
+    CHECK(ws_send(a, "tail", 4, 0) == 4);
+    on = 0;
+    CHECK(ws_ioctlsocket(a, FIONBIO, &on) == 0);
+    WSASetBlockingHook(app_hook);
+    hook_close = a;
+    CHECK(ws_send(a, big, 1021, 0) == SOCKET_ERROR &&
+            WSAGetLastError() == WSAENOTSOCK);
+    CHECK(hook_close == INVALID_SOCKET);
+    WSAUnhookBlockingHook();
+    host_pump(20);
+    closesocket(c);
+}
+
+/* datagrams waiting on the host are pulled together, then served with
+ * their own sizes and sources */
+static void test_udp_queue(void)
+{
+    static char big[20000];
+    struct sockaddr_in usin, psin, from;
+    struct timeval tv = {0};
+    WSADATA d;
+    SOCKET u = udp_bound(&usin), p = udp_bound(&psin);
+    unsigned long calls;
+    u_long n;
+    fd_set rd;
+    char buf[64];
+    int i, fl, got_n = 0, polls;
+
+    CHECK(WSAStartup(0x0101, &d) == 0 && d.iMaxUdpDg == 32767);
+    WSACleanup();
+    memset(big, 'U', sizeof(big));
+    CHECK(ws_sendto(p, big, sizeof(big), 0, (struct sockaddr *)&usin,
+            sizeof(usin)) == sizeof(big));
+    CHECK(ws_recvfrom(u, big, sizeof(big), 0, NULL, NULL) == sizeof(big));
+
+    /* non-blocking by the registration alone, as SNMP/NTP apps have it */
+    CHECK(WSAAsyncSelect(u, APPWND, WM_SOCK, FD_READ) == 0);
+    CHECK(!host_sock_blocking(u));
+    for (i = 0; i < 20; i++)
+        sendto(p, "0123456789abcdefghij", i + 1, 0,
+                (struct sockaddr *)&usin, sizeof(usin));
+    usleep(10000);
+    ngot = 0;
+    polls = host_cnt.selects;
+    calls = host_cnt.d2s_calls;
+    /* one recvfrom() per FD_READ, like apps do */
+    for (i = 0; i < 50 && got_n < 20; i++) {
+        host_pump(2);
+        while (ngot) {
+            ngot = 0;
+            fl = sizeof(from);
+            if (ws_recvfrom(u, buf, sizeof(buf), 0, (struct sockaddr *)&from,
+                    &fl) != got_n + 1 || from.sin_port != psin.sin_port ||
+                    memcmp(buf, "0123456789abcdefghij", got_n + 1))
+                break;
+            got_n++;
+            if (got_n == 3) {
+                /* the next one is queued */
+                CHECK(ws_ioctlsocket(u, FIONREAD, &n) == 0 && n == 4);
+                FD_ZERO(&rd);
+                FD_SET(u, &rd);
+                CHECK(ws_select(0, &rd, NULL, NULL, &tv) == 1);
+            }
+        }
+    }
+    CHECK(got_n == 20);
+    /* the queue saves the polls between datagrams */
+    CHECK(host_cnt.selects - polls < 10);
+    CHECK(host_cnt.d2s_calls - calls < 35);
+
+    /* a short buffer truncates, the rest of the queue is intact */
+    for (i = 0; i < 3; i++)
+        sendto(p, "0123456789", 10, 0, (struct sockaddr *)&usin,
+                sizeof(usin));
+    usleep(10000);
+    CHECK(ws_recvfrom(u, buf, 10, 0, NULL, NULL) == 10);
+    CHECK(ws_recvfrom(u, buf, 4, 0, NULL, NULL) == SOCKET_ERROR &&
+            WSAGetLastError() == WSAEMSGSIZE && memcmp(buf, "0123", 4) == 0);
+    CHECK(ws_recvfrom(u, buf, 10, 0, NULL, NULL) == 10);
+
+    /* the queue is filled for any buffer, not the one of the read that
+     * filled it: FIONREAD-sized reads get each datagram whole */
+    sendto(p, "abcd", 4, 0, (struct sockaddr *)&usin, sizeof(usin));
+    sendto(p, "0123456789abcdefghij", 20, 0, (struct sockaddr *)&usin,
+            sizeof(usin));
+    usleep(10000);
+    CHECK(ws_ioctlsocket(u, FIONREAD, &n) == 0 && n == 4);
+    CHECK(ws_recvfrom(u, buf, n, 0, NULL, NULL) == 4);
+    CHECK(ws_ioctlsocket(u, FIONREAD, &n) == 0 && n == 20);
+    CHECK(ws_recvfrom(u, big, 2000, 0, NULL, NULL) == 20 &&
+            memcmp(big, "0123456789abcdefghij", 20) == 0);
+
+    /* one that doesn't fit the space left waits its turn */
+    sendto(p, "x", 1, 0, (struct sockaddr *)&usin, sizeof(usin));
+    for (i = 0; i < 3; i++) {
+        memset(big, 'a' + i, 3000);
+        sendto(p, big, 3000, 0, (struct sockaddr *)&usin, sizeof(usin));
+    }
+    usleep(10000);
+    CHECK(ws_recvfrom(u, buf, 1, 0, NULL, NULL) == 1);
+    for (i = 0; i < 3; i++) {
+        CHECK(ws_ioctlsocket(u, FIONREAD, &n) == 0 && n == 3000);
+        CHECK(ws_recvfrom(u, big, sizeof(big), 0, NULL, NULL) == 3000 &&
+                big[0] == 'a' + i && big[2999] == 'a' + i);
+    }
+    CHECK(ws_recvfrom(u, buf, sizeof(buf), 0, NULL, NULL) == SOCKET_ERROR &&
+            WSAGetLastError() == WSAEWOULDBLOCK);
+    WSAAsyncSelect(u, APPWND, 0, 0);
+    ws_closesocket(u);
+    ws_closesocket(p);
+}
+
+static int naddrs(const char *buf)
+{
+    const struct hostent *he = (const struct hostent *)buf;
+    int n;
+
+    for (n = 0; he->h_addr_list[n]; n++);
+    return n;
+}
+
+static void test_gethostbyname(void)
+{
+    static char buf[MAXGETHOSTSTRUCT];
+    struct ows_dns_stats st;
+    struct hostent *he = (struct hostent *)buf;
+    unsigned long resolves;
+    HANDLE h;
+    int i;
+
+    OWSFlushDnsCache();
+    ngot = 0;
+    h = WSAAsyncGetHostByName(APPWND, WM_HOST, "multi3.test", buf,
+            sizeof(buf));
+    CHECK(h != 0);
+    host_pump(100);
+    CHECK(ngot == 1 && got[0].wParam == h);
+    CHECK(WSAGETASYNCERROR(got[0].lParam) == 0);
+    CHECK(strcmp(he->h_name, "multi3.test") == 0);
+    CHECK(naddrs(buf) == 3);
+    CHECK(memcmp(he->h_addr_list[2], "\x0a\x00\x00\x03", 4) == 0);
+
+    /* answered from the cache, with a fresh handle */
+    resolves = host_cnt.resolves;
+    ngot = 0;
+    CHECK(WSAAsyncGetHostByName(APPWND, WM_HOST, "MULTI3.test", buf,
+            sizeof(buf)) != h);
+    host_pump(30);
+    CHECK(ngot == 1 && naddrs(buf) == 3);
+    CHECK(host_cnt.resolves == resolves);
+    OWSGetDnsStats(OWS_DNS_FORWARD, &st);
+    CHECK(st.hits == 1 && st.entries == 1);
+
+    /* libd2sock doesn't say why a lookup failed, so it is tried again */
+    resolves = host_cnt.resolves;
+    for (i = 0; i < 2; i++) {
+        ngot = 0;
+        WSAAsyncGetHostByName(APPWND, WM_HOST, "nx.test", buf, sizeof(buf));
+        host_pump(100);
+        CHECK(ngot == 1 &&
+                WSAGETASYNCERROR(got[0].lParam) == WSAHOST_NOT_FOUND);
+    }
+    CHECK(host_cnt.resolves == resolves + 2);
+
+    CHECK(ws_gethostbyname("h7.test") != NULL);
+    CHECK(memcmp(ws_gethostbyname("h7.test")->h_addr, "\x7f\0\0\x07", 4) ==
+            0);
+}
+
+static void test_hostent_size(void)
+{
+    static char buf[MAXGETHOSTSTRUCT];
+    int len;
+
+    /* more addresses than the old fixed layout could hold */
+    ngot = 0;
+    WSAAsyncGetHostByName(APPWND, WM_HOST, "multi20.test", buf, sizeof(buf));
+    host_pump(100);
+    CHECK(ngot == 1 && naddrs(buf) == 20);
+    len = WSAGETASYNCBUFLEN(got[0].lParam);
+
+    /* as many as fit */
+    ngot = 0;
+    WSAAsyncGetHostByName(APPWND, WM_HOST, "multi20.test", buf, len / 2);
+    host_pump(30);
+    CHECK(ngot == 1 && WSAGETASYNCERROR(got[0].lParam) == 0);
+    CHECK(naddrs(buf) > 0 && naddrs(buf) < 20);
+    CHECK(WSAGETASYNCBUFLEN(got[0].lParam) <= len / 2);
+
+    /* not even one: the size needed comes back */
+    ngot = 0;
+    WSAAsyncGetHostByName(APPWND, WM_HOST, "multi20.test", buf, 16);
+    host_pump(30);
+    CHECK(ngot == 1 && WSAGETASYNCERROR(got[0].lParam) == WSAENOBUFS);
+    CHECK(WSAGETASYNCBUFLEN(got[0].lParam) == len);
+}
+
+static void test_gethostbyaddr(void)
+{
+    static char buf[MAXGETHOSTSTRUCT];
+    struct hostent *he = (struct hostent *)buf;
+    struct ows_dns_stats st;
+    DWORD t0;
+    int i;
+
+    OWSFlushDnsCache();
+    for (i = 0; i < 2; i++) {
+        ngot = 0;
+        CHECK(WSAAsyncGetHostByAddr(APPWND, WM_HOST, "\x0a\x01\x02\x03", 4,
+                AF_INET, buf, sizeof(buf)) != 0);
+        host_pump(100);
+        CHECK(ngot == 1 && WSAGETASYNCERROR(got[0].lParam) == 0);
+        CHECK(strcmp(he->h_name, "host-10-1-2-3.test") == 0);
+    }
+    OWSGetDnsStats(OWS_DNS_REVERSE, &st);
+    CHECK(st.hits == 1 && st.misses == 1);
+
+    /* the app's own blocking calls from inside the lookup's hook use
+     * the app's hook, and the lookup is still answered */
+    ngot = 0;
+    setenv("OWS_HOST_DNS_DELAY", "50", 1);
+    CHECK(WSAAsyncGetHostByAddr(APPWND, WM_HOST, "\x0a\x01\x02\x04", 4,
+            AF_INET, buf, sizeof(buf)) != 0);
+    PostMessage(APPWND, WM_BLOCK, 0, 0);
+    host_pump(300);
+    CHECK(block_ok && app_hooks > 0);
+    CHECK(ngot == 1 && WSAGETASYNCERROR(got[0].lParam) == 0);
+    CHECK(strcmp(he->h_name, "host-10-1-2-4.test") == 0);
+
+    /* a cancel stops the wait */
+    setenv("OWS_HOST_DNS_DELAY", "1000", 1);
+    ngot = 0;
+    cancel_h = WSAAsyncGetHostByAddr(APPWND, WM_HOST, "\x0a\x01\x02\x05",
+            4, AF_INET, buf, sizeof(buf));
+    PostMessage(APPWND, WM_CANCEL, 0, 0);
+    t0 = GetTickCount();
+    host_pump(50);
+    unsetenv("OWS_HOST_DNS_DELAY");
+    CHECK(GetTickCount() - t0 < 500 && ngot == 0);
+}
+
+static void test_cancel(void)
+{
+    static char buf[MAXGETHOSTSTRUCT];
+    unsigned long resolves;
+    DWORD t0;
+    HANDLE h, h2;
+    int i;
+
+    OWSFlushDnsCache();
+    ngot = 0;
+    resolves = host_cnt.resolves;
+    h = WSAAsyncGetHostByName(APPWND, WM_HOST, "h9.test", buf, sizeof(buf));
+    CHECK(WSACancelAsyncRequest(h) == 0);
+    CHECK(WSACancelAsyncRequest(h) == SOCKET_ERROR);
+    CHECK(WSAGetLastError() == WSAEINVAL);
+    host_pump(100);
+    /* never started, never answered */
+    CHECK(host_cnt.resolves == resolves && count_msgs(WM_HOST, 0) == 0);
+
+    /* cancelled while the resolver waits: it gives up right away */
+    setenv("OWS_HOST_DNS_DELAY", "1000", 1);
+    cancel_h = WSAAsyncGetHostByName(APPWND, WM_HOST, "h11.test", buf,
+            sizeof(buf));
+    PostMessage(APPWND, WM_CANCEL, 0, 0);
+    t0 = GetTickCount();
+    host_pump(50);
+    unsetenv("OWS_HOST_DNS_DELAY");
+    CHECK(GetTickCount() - t0 < 500);
+    CHECK(host_cnt.resolves == resolves + 1 && ngot == 0);
+    CHECK(WSACancelAsyncRequest(cancel_h) == SOCKET_ERROR);
+    CHECK(WSAGetLastError() == WSAEINVAL);
+
+    /* answered already, from the resolver or from the cache */
+    h = WSAAsyncGetHostByName(APPWND, WM_HOST, "h9.test", buf, sizeof(buf));
+    host_pump(50);
+    CHECK(count_msgs(WM_HOST, 0) == 1);
+    CHECK(WSACancelAsyncRequest(h) == SOCKET_ERROR);
+    CHECK(WSAGetLastError() == WSAEALREADY);
+    h = WSAAsyncGetHostByName(APPWND, WM_HOST, "h9.test", buf, sizeof(buf));
+    CHECK(WSACancelAsyncRequest(h) == SOCKET_ERROR);
+    CHECK(WSAGetLastError() == WSAEALREADY);
+    host_pump(10);
+
+    /* the slot is reused, the old handle stays invalid */
+    CHECK(WSAAsyncGetHostByName(APPWND, WM_HOST, "h10.test", buf,
+            sizeof(buf)) != h);
+    CHECK(WSACancelAsyncRequest(h) == SOCKET_ERROR);
+    CHECK(WSACancelAsyncRequest(0) == SOCKET_ERROR);
+    host_pump(100);
+
+    /* cache hits don't wrap the generation of the next request's slot */
+    h = WSAAsyncGetHostByName(APPWND, WM_HOST, "h9.test", buf, sizeof(buf));
+    host_pump(50);
+    for (i = 0; i < 63; i++)
+        WSAAsyncGetHostByName(APPWND, WM_HOST, "h9.test", buf, sizeof(buf));
+    host_pump(10);
+    ngot = 0;
+    h2 = WSAAsyncGetHostByName(APPWND, WM_HOST, "h12.test", buf, sizeof(buf));
+    CHECK(h2 != h && WSACancelAsyncRequest(h) == SOCKET_ERROR);
+    host_pump(100);
+    CHECK(count_msgs(WM_HOST, 0) == 1);
+}
+
+/* With DnsServer set, lookups are queries on one socket, answered as
+ * the replies come in rather than nested in the blocking hook. */
+#define RES_N 8
+static void test_resolver(void)
+{
+    static char buf[RES_N][MAXGETHOSTSTRUCT];
+    struct hostent *he = (struct hostent *)buf[0];
+    unsigned long resolves, hooks, queries;
+    char srv[32], name[32];
+    HANDLE h[RES_N];
+    WSADATA d;
+    MSG m;
+    int i, j;
+
+    snprintf(srv, sizeof(srv), "127.0.0.1:%d", host_dns_start());
+    setenv("OWS_DNSSERVER", srv, 1);
+    setenv("OWS_DNSTIMEOUT", "60", 1);
+    setenv("OWS_DNSRETRIES", "2", 1);
+    /* read when the first app starts */
+    WSACleanup();
+    CHECK(WSAStartup(0x0101, &d) == 0);
+    OWSFlushDnsCache();
+
+    resolves = host_cnt.resolves;
+    hooks = host_cnt.hooks;
+    queries = host_dns.queries;
+    ngot = 0;
+    for (i = 0; i < RES_N; i++) {
+        snprintf(name, sizeof(name), "h%d.test", i + 1);
+        h[i] = WSAAsyncGetHostByName(APPWND, WM_HOST, name, buf[i],
+                sizeof(buf[i]));
+    }
+    host_pump(100);
+    CHECK(count_msgs(WM_HOST, 0) == RES_N);
+    CHECK(host_cnt.resolves == resolves && host_cnt.hooks == hooks);
+    CHECK(host_dns.queries == queries + RES_N);
+    for (i = 0; i < ngot; i++) {
+        for (j = 0; j < RES_N && got[i].wParam != h[j]; j++);
+        he = (struct hostent *)buf[j];
+        CHECK(j < RES_N && WSAGETASYNCERROR(got[i].lParam) == 0 &&
+                (u_char)he->h_addr_list[0][3] == j + 1);
+    }
+
+    ngot = 0;
+    he = (struct hostent *)buf[0];
+    WSAAsyncGetHostByName(APPWND, WM_HOST, "CName7.test.", buf[0],
+            sizeof(buf[0]));
+    WSAAsyncGetHostByName(APPWND, WM_HOST, "nx.test", buf[1], sizeof(buf[1]));
+    host_pump(100);
+    CHECK(count_msgs(WM_HOST, 0) == 2);
+    CHECK(strcmp(he->h_name, "h7.test") == 0 && he->h_aliases[0] &&
+            strcmp(he->h_aliases[0], "cname7.test") == 0);
+    CHECK(memcmp(he->h_addr_list[0], "\x7f\x00\x00\x07", 4) == 0);
+    for (i = 0; i < ngot && got[i].wParam; i++) {
+        if (WSAGETASYNCERROR(got[i].lParam) == WSAHOST_NOT_FOUND)
+            break;
+    }
+    CHECK(i < ngot);
+
+    /* only addresses of the name asked for */
+    ngot = 0;
+    WSAAsyncGetHostByName(APPWND, WM_HOST, "stray5.test", buf[0],
+            sizeof(buf[0]));
+    host_pump(100);
+    CHECK(ngot == 1 && WSAGETASYNCERROR(got[0].lParam) == 0);
+    CHECK(memcmp(he->h_addr_list[0], "\x7f\x00\x00\x05", 4) == 0 &&
+            !he->h_addr_list[1]);
+    ngot = 0;
+    WSAAsyncGetHostByName(APPWND, WM_HOST, "lure5.test", buf[0],
+            sizeof(buf[0]));
+    host_pump(100);
+    CHECK(ngot == 1 && WSAGETASYNCERROR(got[0].lParam) == WSANO_DATA);
+
+    /* what the server says of a name is cached with its own error,
+     * a server failure isn't */
+    queries = host_dns.queries;
+    ngot = 0;
+    WSAAsyncGetHostByName(APPWND, WM_HOST, "nx.test", buf[0],
+            sizeof(buf[0]));
+    WSAAsyncGetHostByName(APPWND, WM_HOST, "lure5.test", buf[0],
+            sizeof(buf[0]));
+    host_pump(20);
+    CHECK(ngot == 2 &&
+            WSAGETASYNCERROR(got[0].lParam) == WSAHOST_NOT_FOUND &&
+            WSAGETASYNCERROR(got[1].lParam) == WSANO_DATA);
+    CHECK(ws_gethostbyname("lure5.test") == NULL &&
+            WSAGetLastError() == WSANO_DATA);
+    CHECK(host_dns.queries == queries);
+    for (i = 0; i < 2; i++) {
+        ngot = 0;
+        WSAAsyncGetHostByName(APPWND, WM_HOST, "fail1.test", buf[0],
+                sizeof(buf[0]));
+        host_pump(100);
+        CHECK(ngot == 1 &&
+                WSAGETASYNCERROR(got[0].lParam) == WSATRY_AGAIN);
+    }
+    CHECK(host_dns.queries == queries + 2);
+
+    /* lost queries are sent again, 60 then 120 ms later, give or
+     * take the poll timer, each with an ID of its own */
+    ngot = 0;
+    queries = host_dns.queries;
+    host_dns.drop = 2;
+    WSAAsyncGetHostByName(APPWND, WM_HOST, "h20.test", buf[0],
+            sizeof(buf[0]));
+    host_pump(50);
+    CHECK(ngot == 0);
+    host_pump(700);
+    CHECK(ngot == 1 && WSAGETASYNCERROR(got[0].lParam) == 0);
+    CHECK(host_dns.queries == queries + 3);
+    CHECK(host_dns.ids[queries % 8] != host_dns.ids[(queries + 1) % 8] &&
+            host_dns.ids[queries % 8] != host_dns.ids[(queries + 2) % 8] &&
+            host_dns.ids[(queries + 1) % 8] !=
+            host_dns.ids[(queries + 2) % 8]);
+
+    /* a server that never answers is given up on */
+    ngot = 0;
+    host_dns.drop = 100;
+    WSAAsyncGetHostByName(APPWND, WM_HOST, "h21.test", buf[0],
+            sizeof(buf[0]));
+    host_pump(1200);
+    CHECK(ngot == 1 && WSAGETASYNCERROR(got[0].lParam) == WSATRY_AGAIN);
+    host_dns.drop = 0;
+
+    /* cancelled while the query is out */
+    ngot = 0;
+    host_dns.delay = 50;
+    h[0] = WSAAsyncGetHostByName(APPWND, WM_HOST, "h22.test", buf[0],
+            sizeof(buf[0]));
+    host_pump(10);
+    CHECK(WSACancelAsyncRequest(h[0]) == 0);
+    host_pump(100);
+    CHECK(ngot == 0);
+    host_dns.delay = 0;
+
+    /* answered by another task's run that read the reply: the app has
+     * it before its own dispatcher runs, a cancel is too late */
+    host_dns.delay = 30;
+    host_set_task(2);
+    CHECK(WSAStartup(0x0101, &d) == 0);
+    h[0] = WSAAsyncGetHostByName(APPWND2, WM_HOST, "h23.test", buf[0],
+            sizeof(buf[0]));
+    host_pump(5);
+    host_set_task(1);
+    ngot = 0;
+    WSAAsyncGetHostByName(APPWND, WM_HOST, "h24.test", buf[1],
+            sizeof(buf[1]));
+    host_pump(100);
+    CHECK(ngot == 1 && got[0].hwnd == APPWND);
+    host_set_task(2);
+    while (ngot == 1 && PeekMessage(&m, 0, 0, 0, PM_REMOVE))
+        DispatchMessage(&m);
+    CHECK(ngot == 2 && got[1].wParam == h[0]);
+    CHECK(WSACancelAsyncRequest(h[0]) == SOCKET_ERROR);
+    CHECK(WSAGetLastError() == WSAEALREADY);
+    host_pump(10);
+    WSACleanup();
+    host_set_task(1);
+    host_dns.delay = 0;
+
+    /* numbers need no server */
+    ngot = 0;
+    WSAAsyncGetHostByName(APPWND, WM_HOST, "10.1.2.3", buf[0],
+            sizeof(buf[0]));
+    host_pump(50);
+    CHECK(ngot == 1 && host_cnt.resolves == resolves + 1);
+
+    unsetenv("OWS_DNSSERVER");
+    unsetenv("OWS_DNSTIMEOUT");
+    unsetenv("OWS_DNSRETRIES");
+    WSACleanup();
+    CHECK(WSAStartup(0x0101, &d) == 0);
+}
+
+static void test_netdb(void)
+{
+    static char buf[MAXGETHOSTSTRUCT];
+    struct servent *se;
+
+    se = ws_getservbyname("http", NULL);
+    CHECK(se && ntohs(se->s_port) == 80 && strcmp(se->s_proto, "tcp") == 0);
+    se = ws_getservbyname("WWW", "tcp");
+    CHECK(se && strcmp(se->s_name, "http") == 0);
+    se = ws_getservbyport(htons(53), "udp");
+    CHECK(se && strcmp(se->s_name, "domain") == 0);
+    CHECK(ws_getservbyname("no-such-service", NULL) == NULL);
+    CHECK(WSAGetLastError() == WSANO_DATA);
+    CHECK(ws_getprotobyname("UDP") && ws_getprotobyname("UDP")->p_proto == 17);
+    CHECK(ws_getprotobynumber(6) &&
+            strcmp(ws_getprotobynumber(6)->p_name, "tcp") == 0);
+    /* from the services file, too large for the static buffer */
+    CHECK(ws_getservbyname("huge", "tcp") == NULL);
+    CHECK(WSAGetLastError() == WSANO_RECOVERY);
+    CHECK(ws_getservbyport(htons(9999), "tcp") == NULL);
+    CHECK(WSAGetLastError() == WSANO_RECOVERY);
+    CHECK(ws_getservbyname(NULL, NULL) == NULL);
+    CHECK(WSAGetLastError() == WSAEFAULT);
+    CHECK(ws_getprotobyname(NULL) == NULL);
+    CHECK(WSAGetLastError() == WSAEFAULT);
+    CHECK(ws_gethostbyname(NULL) == NULL);
+    CHECK(WSAGetLastError() == WSAEFAULT);
+    CHECK(ws_gethostbyaddr(NULL, 4, AF_INET) == NULL);
+    CHECK(WSAGetLastError() == WSAEFAULT);
+
+    ngot = 0;
+    WSAAsyncGetServByName(APPWND, WM_HOST, "smtp", "tcp", buf, sizeof(buf));
+    host_pump(10);
+    CHECK(ngot == 1 && WSAGETASYNCERROR(got[0].lParam) == 0);
+    CHECK(ntohs(((struct servent *)buf)->s_port) == 25);
+    ngot = 0;
+    WSAAsyncGetServByName(APPWND, WM_HOST, "smtp", "tcp", buf, 8);
+    host_pump(10);
+    CHECK(ngot == 1 && WSAGETASYNCERROR(got[0].lParam) == WSAENOBUFS);
+    /* no buffer at all is the app's fault, not a short one */
+    ngot = 0;
+    CHECK(WSAAsyncGetServByName(APPWND, WM_HOST, "smtp", "tcp", NULL,
+            sizeof(buf)) == 0);
+    CHECK(WSAGetLastError() == WSAEFAULT);
+    CHECK(WSAAsyncGetProtoByNumber(APPWND, WM_HOST, 6, NULL,
+            sizeof(buf)) == 0);
+    CHECK(WSAGetLastError() == WSAEFAULT);
+    host_pump(10);
+    CHECK(ngot == 0);
+}
+
+static void test_stats(void)
+{
+    static struct ows_stats st;
+    char path[] = "/tmp/owstestXXXXXX";
+    char hdr[4];
+    SOCKET s;
+    FILE *f;
+    int fd;
+
+    CHECK(OWSGetStats(&st) == 0);
+    CHECK(st.api[OWS_API_RECV].calls >= 2);
+    CHECK(st.api[OWS_API_ASYNCSELECT].calls >= 2);
+    CHECK(st.polls > 0 && st.posts > 0);
+
+    /* each export on its own */
+    OWSResetStats();
+    s = ws_socket(AF_INET, SOCK_STREAM, 0);
+    ws_closesocket(s);
+    WSASetLastError(WSAEINTR);
+    WSAGetLastError();
+    WSAGetLastError();
+    WSASetBlockingHook(app_hook);
+    WSAUnhookBlockingHook();
+    ws_getservbyport(htons(80), "tcp");
+    CHECK(OWSGetStats(&st) == 0);
+    CHECK(st.api[OWS_API_SOCKET].calls == 1 &&
+            st.api[OWS_API_CLOSESOCKET].calls == 1);
+    CHECK(st.api[OWS_API_SETLASTERROR].calls == 1 &&
+            st.api[OWS_API_GETLASTERROR].calls == 2);
+    CHECK(st.api[OWS_API_SETBLOCKINGHOOK].calls == 1 &&
+            st.api[OWS_API_UNHOOKBLOCKINGHOOK].calls == 1);
+    CHECK(st.api[OWS_API_GETSERVBYPORT].calls == 1 &&
+            st.api[OWS_API_GETSERVBYNAME].calls == 0);
+
+    fd = mkstemp(path);
+    close(fd);
+    CHECK(OWSDumpTrace(path) == 0);
+    f = fopen(path, "rb");
+    CHECK(f && fread(hdr, 1, 4, f) == 4 && memcmp(hdr, "OWST", 4) == 0);
+    if (f)
+        fclose(f);
+    unlink(path);
+}
+
+/* a services file for test_netdb, read at the first WSAStartup() */
+static char services[] = "/tmp/ows-servicesXXXXXX";
+
+static void write_services(void)
+{
+    int fd = mkstemp(services);
+    FILE *f = fdopen(fd, "w");
+    int i;
+
+    fprintf(f, "# one entry larger than MAXGETHOSTSTRUCT\nhuge 9999/tcp");
+    for (i = 0; i < 8; i++)
+        fprintf(f, " alias%d-%0150d", i, 0);
+    fprintf(f, "\n");
+    fclose(f);
+    setenv("OWS_SERVICES", services, 1);
+}
+
+/* a services file over the size limit is ignored, not parsed cut */
+static void test_netdb_oversized(void)
+{
+    WSADATA d;
+    FILE *f = fopen(services, "w");
+    int i;
+
+    for (i = 0; i < 4000; i++)
+        fprintf(f, "svc%d %d/tcp\n", i, 10000 + i);
+    fclose(f);
+    LibMain(1, 0, 1024, "");
+    CHECK(WSAStartup(0x0101, &d) == 0);
+    CHECK(ws_getservbyname("svc0", "tcp") == NULL);
+    CHECK(ws_getservbyname("http", "tcp") != NULL);
+    WSACleanup();
+    WEP(0);
+}
+
+int main(void)
+{
+    WSADATA d;
+
+    setenv("OWS_TRACE", "256", 1);
+    write_services();
+    LibMain(1, 0, 1024, "");
+    if (WSAStartup(0x0101, &d)) {
+        printf("WSAStartup failed\n");
+        return 1;
+    }
+    test_async_select();
+    test_accept();
+    test_max_sockets();
+    test_reregister();
+    test_post_fail();
+    test_fairness();
+    test_blocking_wait();
+    test_vectored();
+    test_readahead();
+    test_select_nested();
+    test_write_combine();
+    test_udp_queue();
+    test_query_cache();
+    test_gethostbyname();
+    test_hostent_size();
+    test_gethostbyaddr();
+    test_cancel();
+    test_resolver();
+    test_netdb();
+    test_cleanup();
+    test_cleanup_nested();
+    test_stats();
+    WSACleanup();
+    WEP(0);
+    test_netdb_oversized();
+    unlink(services);
+    if (failed) {
+        printf("%d checks failed\n", failed);
+        return 1;
+    }
+    printf("all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,404 @@
+/*
+ *  Open Winsock - minimal Win16 USER/KERNEL emulation for host builds
+ *  Copyright (C) 2025  @stsp
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * One message queue per emulated task, windows belong to the task
+ * that created them, timers fire from PeekMessage() like on Win16.
+ * Everything is single-threaded: the caller switches tasks with
+ * host_set_task().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <winsock.h>
+#include "host.h"
+
+#define MAX_WND 256
+#define MAX_QUEUE 4096
+#define MAX_TIMERS 64
+#define MAX_GLOBAL 1024
+
+struct wnd {
+    int used;
+    HTASK task;
+    WNDPROC proc;
+    LONG extra;
+};
+
+struct timer {
+    HWND hwnd;
+    UINT id;
+    UINT elapse;
+    DWORD due;
+};
+
+static struct wnd wnds[MAX_WND];
+static WNDCLASS wclass;
+static MSG queue[MAX_QUEUE];
+static int q_head, q_len;
+static struct timer timers[MAX_TIMERS];
+static void *globals[MAX_GLOBAL];
+static HTASK cur_task = 1;
+static int queue_limit = MAX_QUEUE;
+
+struct host_counters host_cnt;
+
+void host_set_task(HTASK task)
+{
+    cur_task = task;
+}
+
+void host_set_queue_limit(int limit)
+{
+    queue_limit = limit ? limit : MAX_QUEUE;
+}
+
+BOOL RegisterClass(const WNDCLASS *wc)
+{
+    wclass = *wc;
+    return TRUE;
+}
+
+HWND CreateWindow(LPCSTR cls, LPCSTR name, DWORD style, int x, int y,
+        int w, int h, HWND parent, HANDLE menu, HINSTANCE inst, void *param)
+{
+    int i;
+
+    for (i = 1; i < MAX_WND; i++) {
+        if (!wnds[i].used) {
+            wnds[i].used = 1;
+            wnds[i].task = cur_task;
+            wnds[i].proc = wclass.lpfnWndProc;
+            wnds[i].extra = 0;
+            host_cnt.windows++;
+            if (host_cnt.windows > host_cnt.windows_max)
+                host_cnt.windows_max = host_cnt.windows;
+            return i;
+        }
+    }
+    return 0;
+}
+
+BOOL DestroyWindow(HWND hWnd)
+{
+    int i;
+
+    if (!IsWindow(hWnd))
+        return FALSE;
+    for (i = 0; i < MAX_TIMERS; i++) {
+        if (timers[i].hwnd == hWnd)
+            timers[i].hwnd = 0;
+    }
+    wnds[hWnd].used = 0;
+    host_cnt.windows--;
+    return TRUE;
+}
+
+BOOL IsWindow(HWND hWnd)
+{
+    return hWnd > 0 && hWnd < MAX_WND && wnds[hWnd].used;
+}
+
+/* messages to app windows (not ours) are just queued for host_get_msg() */
+BOOL PostMessage(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam)
+{
+    MSG *m;
+
+    if (q_len >= queue_limit)
+        return FALSE;
+    m = &queue[(q_head + q_len) % MAX_QUEUE];
+    m->hwnd = hWnd;
+    m->message = msg;
+    m->wParam = wParam;
+    m->lParam = lParam;
+    m->time = GetTickCount();
+    q_len++;
+    host_cnt.posts++;
+    return TRUE;
+}
+
+static HTASK msg_task(const MSG *m)
+{
+    if (IsWindow(m->hwnd))
+        return wnds[m->hwnd].task;
+    return host_wnd_task(m->hwnd);
+}
+
+static int take_msg(MSG *msg, int remove)
+{
+    int i;
+
+    for (i = 0; i < q_len; i++) {
+        MSG *m = &queue[(q_head + i) % MAX_QUEUE];
+        int j;
+
+        if (msg_task(m) != cur_task)
+            continue;
+        *msg = *m;
+        if (!remove)
+            return 1;
+        for (j = i; j > 0; j--)
+            queue[(q_head + j) % MAX_QUEUE] =
+                    queue[(q_head + j - 1) % MAX_QUEUE];
+        q_head = (q_head + 1) % MAX_QUEUE;
+        q_len--;
+        return 1;
+    }
+    return 0;
+}
+
+static int take_timer(MSG *msg, int remove)
+{
+    DWORD now = GetTickCount();
+    int i;
+
+    for (i = 0; i < MAX_TIMERS; i++) {
+        struct timer *t = &timers[i];
+
+        if (!t->hwnd || wnds[t->hwnd].task != cur_task)
+            continue;
+        if ((int32_t)(now - t->due) < 0)
+            continue;
+        msg->hwnd = t->hwnd;
+        msg->message = WM_TIMER;
+        msg->wParam = t->id;
+        msg->lParam = 0;
+        msg->time = now;
+        if (remove)
+            t->due = now + t->elapse;
+        return 1;
+    }
+    return 0;
+}
+
+BOOL PeekMessage(MSG *msg, HWND hWnd, UINT first, UINT last, UINT flags)
+{
+    host_cnt.peeks++;
+    if (take_msg(msg, flags & PM_REMOVE))
+        return TRUE;
+    return take_timer(msg, flags & PM_REMOVE);
+}
+
+void host_pump(int ms)
+{
+    DWORD end = GetTickCount() + ms;
+    MSG m;
+
+    do {
+        if (!PeekMessage(&m, 0, 0, 0, PM_REMOVE)) {
+            usleep(100);
+            continue;
+        }
+        DispatchMessage(&m);
+    } while ((int32_t)(GetTickCount() - end) < 0);
+}
+
+BOOL TranslateMessage(const MSG *msg)
+{
+    return FALSE;
+}
+
+LRESULT DispatchMessage(const MSG *msg)
+{
+    if (!IsWindow(msg->hwnd)) {
+        host_app_msg(msg);
+        return 0;
+    }
+    return wnds[msg->hwnd].proc(msg->hwnd, msg->message, msg->wParam,
+            msg->lParam);
+}
+
+LRESULT DefWindowProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam)
+{
+    return 0;
+}
+
+LONG SetWindowLong(HWND hWnd, int idx, LONG val)
+{
+    LONG old = wnds[hWnd].extra;
+
+    wnds[hWnd].extra = val;
+    return old;
+}
+
+LONG GetWindowLong(HWND hWnd, int idx)
+{
+    return wnds[hWnd].extra;
+}
+
+UINT SetTimer(HWND hWnd, UINT id, UINT elapse, FARPROC func)
+{
+    int i, fr = -1;
+
+    host_cnt.timers++;
+    for (i = 0; i < MAX_TIMERS; i++) {
+        if (timers[i].hwnd == hWnd && timers[i].id == id) {
+            fr = i;
+            break;
+        }
+        if (fr == -1 && !timers[i].hwnd)
+            fr = i;
+    }
+    if (fr == -1)
+        return 0;
+    timers[fr].hwnd = hWnd;
+    timers[fr].id = id;
+    /* Win16 timers tick at 55ms granularity */
+    timers[fr].elapse = elapse < 55 ? 55 : elapse;
+    timers[fr].due = GetTickCount() + timers[fr].elapse;
+    return id;
+}
+
+BOOL KillTimer(HWND hWnd, UINT id)
+{
+    int i;
+
+    for (i = 0; i < MAX_TIMERS; i++) {
+        if (timers[i].hwnd == hWnd && timers[i].id == id) {
+            timers[i].hwnd = 0;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+HTASK GetCurrentTask(void)
+{
+    return cur_task;
+}
+
+DWORD GetTickCount(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* [OpenWinsock] Key=val maps to OWS_KEY=val in the environment */
+static const char *profile_env(LPCSTR key)
+{
+    char name[64];
+    int i;
+
+    snprintf(name, sizeof(name), "OWS_%s", key);
+    for (i = 0; name[i]; i++)
+        name[i] = toupper((unsigned char)name[i]);
+    return getenv(name);
+}
+
+UINT GetProfileInt(LPCSTR app, LPCSTR key, int def)
+{
+    const char *v = profile_env(key);
+
+    return v ? atoi(v) : def;
+}
+
+int GetProfileString(LPCSTR app, LPCSTR key, LPCSTR def, LPSTR buf, int len)
+{
+    const char *v = profile_env(key);
+
+    if (!v)
+        v = def;
+    snprintf(buf, len, "%s", v);
+    return strlen(buf);
+}
+
+HGLOBAL GlobalAlloc(UINT flags, DWORD size)
+{
+    int i;
+
+    for (i = 1; i < MAX_GLOBAL; i++) {
+        if (!globals[i]) {
+            globals[i] = (flags & GMEM_ZEROINIT) ? calloc(1, size) :
+                    malloc(size);
+            return globals[i] ? i : 0;
+        }
+    }
+    return 0;
+}
+
+HGLOBAL GlobalReAlloc(HGLOBAL h, DWORD size, UINT flags)
+{
+    void *p = realloc(globals[h], size);
+
+    if (!p)
+        return 0;
+    globals[h] = p;
+    return h;
+}
+
+HGLOBAL GlobalFree(HGLOBAL h)
+{
+    free(globals[h]);
+    globals[h] = NULL;
+    return 0;
+}
+
+void *GlobalLock(HGLOBAL h)
+{
+    return globals[h];
+}
+
+BOOL GlobalUnlock(HGLOBAL h)
+{
+    return TRUE;
+}
+
+HFILE _lcreat(LPCSTR path, int attr)
+{
+    int fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+
+    return fd < 0 ? HFILE_ERROR : fd;
+}
+
+HFILE _lopen(LPCSTR path, int mode)
+{
+    int fd = open(path, O_RDONLY);
+
+    return fd < 0 ? HFILE_ERROR : fd;
+}
+
+UINT _lread(HFILE f, void *buf, UINT len)
+{
+    return read(f, buf, len);
+}
+
+UINT _lwrite(HFILE f, const void *buf, UINT len)
+{
+    return write(f, buf, len);
+}
+
+HFILE _lclose(HFILE f)
+{
+    close(f);
+    return 0;
+}
+
+UINT GetWindowsDirectory(LPSTR buf, UINT len)
+{
+    const char *v = getenv("OWS_WINDIR");
+
+    snprintf(buf, len, "%s", v ? v : ".");
+    return strlen(buf);
+}
@@ -0,0 +1,162 @@
+/*
+ *  Open Winsock - winsock-1.1/win16 (winsock.dll) for Windows-3.1
+ *  Copyright (C) 2025  @stsp
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published
+ *  by the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Open Winsock vendor extensions. Include after winsock.h. */
+
+#ifndef OWINSOCK_H
+#define OWINSOCK_H
+
+/* usage of a fixed-size record pool */
+struct ows_pool_stats {
+    int size;       /* records in the pool */
+    int used;       /* records in use now */
+    int hwm;        /* most records ever in use at once */
+    int fails;      /* allocations refused with WSAENOBUFS */
+};
+
+/* async select registration records */
+#define OWS_POOL_ASEL 0
+
+int PASCAL FAR OWSGetPoolStats(int pool, struct ows_pool_stats FAR *stats);
+
+/* name resolution caches */
+struct ows_dns_stats {
+    DWORD hits;
+    DWORD misses;
+    int entries;    /* names cached now */
+    int size;       /* max names cached */
+};
+
+#define OWS_DNS_FORWARD 0
+#define OWS_DNS_REVERSE 1
+
+int PASCAL FAR OWSGetDnsStats(int cache, struct ows_dns_stats FAR *stats);
+int PASCAL FAR OWSFlushDnsCache(void);
+
+/* Call counters and latencies, in ms (GetTickCount() resolution), one
+ * per export the DLL implements, in winsock.def order. listen(),
+ * gethostname(), __WSAFDIsSet(), the byte order and inet_* helpers go
+ * to libd2sock directly and aren't counted. Latencies are kept for
+ * the calls that may block; the pieces of OWSSendV()/OWSRecvV() also
+ * count as send()/recv(). */
+#define OWS_HIST_BUCKETS 8      /* 0, <=55, <=110, ... <=1760, more */
+
+struct ows_api_stats {
+    DWORD calls;
+    DWORD total_ms;
+    DWORD max_ms;
+    DWORD hist[OWS_HIST_BUCKETS];
+};
+
+enum {
+    OWS_API_ACCEPT,
+    OWS_API_BIND,
+    OWS_API_CLOSESOCKET,
+    OWS_API_CONNECT,
+    OWS_API_GETPEERNAME,
+    OWS_API_GETSOCKNAME,
+    OWS_API_GETSOCKOPT,
+    OWS_API_IOCTLSOCKET,
+    OWS_API_RECV,
+    OWS_API_RECVFROM,
+    OWS_API_SELECT,
+    OWS_API_SEND,
+    OWS_API_SENDTO,
+    OWS_API_SETSOCKOPT,
+    OWS_API_SHUTDOWN,
+    OWS_API_SOCKET,
+    OWS_API_GETHOSTBYADDR,
+    OWS_API_GETHOSTBYNAME,
+    OWS_API_GETPROTOBYNAME,
+    OWS_API_GETPROTOBYNUMBER,
+    OWS_API_GETSERVBYNAME,
+    OWS_API_GETSERVBYPORT,
+    OWS_API_ASYNCSELECT,
+    OWS_API_ASYNCGETHOSTBYADDR,
+    OWS_API_ASYNCGETHOSTBYNAME,
+    OWS_API_ASYNCGETPROTOBYNUMBER,
+    OWS_API_ASYNCGETPROTOBYNAME,
+    OWS_API_ASYNCGETSERVBYPORT,
+    OWS_API_ASYNCGETSERVBYNAME,
+    OWS_API_CANCELASYNC,
+    OWS_API_SETBLOCKINGHOOK,
+    OWS_API_UNHOOKBLOCKINGHOOK,
+    OWS_API_GETLASTERROR,
+    OWS_API_SETLASTERROR,
+    OWS_API_CANCELBLOCKINGCALL,
+    OWS_API_ISBLOCKING,
+    OWS_API_STARTUP,
+    OWS_API_CLEANUP,
+    OWS_API_SENDV,
+    OWS_API_RECVV,
+    OWS_API_RESOLVE,            /* host lookups run by the dispatcher */
+    OWS_API_COUNT
+};
+
+struct ows_stats {
+    DWORD polls;                /* select() passes of the dispatchers */
+    DWORD timer_sets;           /* poll timer re-arms */
+    DWORD timer_fires;
+    DWORD kicks;                /* immediate re-polls posted */
+    DWORD hooks;                /* blocking hook invocations */
+    DWORD posts;                /* notifications posted to apps */
+    int queue;                  /* async requests pending now */
+    int queue_hwm;
+    struct ows_pool_stats asel_pool;
+    struct ows_api_stats api[OWS_API_COUNT];
+    DWORD dns_queries;          /* sent by the resolver, see DnsServer */
+    DWORD dns_retries;
+};
+
+int PASCAL FAR OWSGetStats(struct ows_stats FAR *stats);
+/* async notifications of one task, see WIN.INI EventBudget/TaskQueue */
+struct ows_task_stats {
+    DWORD posts;                /* notifications posted */
+    DWORD deferred;             /* runs that left events for the next */
+    DWORD post_fails;           /* PostMessage() failed, posted later */
+    DWORD wait_ms;              /* total ready-to-posted time of events */
+    DWORD wait_max;
+    int queue;                  /* async requests pending now */
+    int queue_hwm;
+    int refused;                /* requests over TaskQueue */
+};
+
+/* task 0 is the calling one */
+int PASCAL FAR OWSGetTaskStats(HTASK task, struct ows_task_stats FAR *stats);
+int PASCAL FAR OWSResetStats(void);
+/* write the statistics as text */
+int PASCAL FAR OWSDumpStats(LPCSTR path);
+
+/* one piece of a gather/scatter list */
+struct ows_buf {
+    char FAR *buf;
+    int len;
+};
+
+/* send or receive a list of buffers with one call to the network
+ * stack, up to 8K per call; return and errors are as for send/recv */
+int PASCAL FAR OWSSendV(SOCKET s, const struct ows_buf FAR *bufs, int nbufs,
+        int flags);
+int PASCAL FAR OWSRecvV(SOCKET s, struct ows_buf FAR *bufs, int nbufs,
+        int flags);
+
+/* write the trace ring (WIN.INI Trace) to a file or a COM port,
+ * decode with owstrace.py */
+int PASCAL FAR OWSDumpTrace(LPCSTR path);
+
+#endif
@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+#
+#  Open Winsock - decoder for OWSDumpTrace() dumps
+#  Copyright (C) 2025  @stsp
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU Lesser General Public License as published
+#  by the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU Lesser General Public License for more details.
+#
+#  You should have received a copy of the GNU Lesser General Public License
+#  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+"""Usage: owstrace.py DUMP [winsock.c]
+
+Records carry __LINE__ of the trace point, so function names and event
+names are taken from the winsock.c the DLL was built from.
+"""
+
+import re
+import struct
+import sys
+
+HDR = struct.Struct("<4sHHHHI")
+REC = struct.Struct("<IHHHHI")
+
+
+def parse_source(path):
+    events = {}
+    funcs = {}
+    with open(path, errors="replace") as f:
+        lines = f.read().split("\n")
+    in_enum = False
+    num = 0
+    pending = None
+    cur = None
+    for no, line in enumerate(lines, 1):
+        if re.match(r"^enum \{", line):
+            in_enum = True
+            num = 0
+            continue
+        if in_enum:
+            m = re.match(r"^\s*(TR_\w+)(\s*=\s*(\d+))?,", line)
+            if m:
+                if m.group(3):
+                    num = int(m.group(3))
+                events[num] = m.group(1)[3:]
+                num += 1
+            elif line.startswith("}"):
+                in_enum = False
+            continue
+        m = re.match(r"^[A-Za-z_][^;=#]*?\b(\w+)\s*\(", line)
+        if m and not line.rstrip().endswith(";"):
+            pending = m.group(1)
+        elif line == "{" and pending:
+            cur = pending
+            pending = None
+        elif line.startswith("}"):
+            funcs[no] = cur
+            cur = None
+        if cur:
+            funcs[no] = cur
+    return events, funcs
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit(__doc__)
+    src = sys.argv[2] if len(sys.argv) > 2 else "winsock.c"
+    events, funcs = parse_source(src)
+    with open(sys.argv[1], "rb") as f:
+        data = f.read()
+    magic, ver, recsize, count, _, total = HDR.unpack_from(data)
+    if magic != b"OWST" or ver != 1 or recsize != REC.size:
+        sys.exit("%s: not an Open Winsock trace" % sys.argv[1])
+    print("%d records, %d lost" % (count, total - count))
+    prev = None
+    for i in range(count):
+        tick, ev, line, s, a1, a2 = REC.unpack_from(data,
+                                                    HDR.size + i * REC.size)
+        delta = 0 if prev is None else (tick - prev) & 0xffffffff
+        prev = tick
+        name = events.get(ev, "EV%d" % ev)
+        where = "%s:%d" % (funcs.get(line) or "?", line)
+        if name in ("ENTER", "LEAVE"):
+            args = ""
+        elif name == "POST":
+            args = "hwnd=%#x msg=%#x lp=%#x/%d" % (s, a1, a2 & 0xffff,
+                                                  a2 >> 16)
+        else:
+            if a1 & 0x8000:
+                a1 -= 0x10000
+            args = "s=%d a1=%d a2=%#x" % (s, a1, a2)
+        print("%10u +%-5u %-28s %-6s %s" % (tick, delta, where, name, args))
+
+
+if __name__ == "__main__":
+    main()
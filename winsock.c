@@ -18,40 +18,280 @@
 
 #include <winsock.h>
 #include <d2sock.h>
+#include "owinsock.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <errno.h>
 #include <assert.h>
+#include <limits.h>
+
+struct async_base;
+
+/* iMaxSockets. socket() and accept() refuse host descriptors from
+ * here on, so every socket an app has fits the per-socket tables. */
+#define MAX_SOCKETS 256
+
+/* winsock fd_set is a counted array, so select() takes larger ones too */
+struct sock_set {
+    u_int fd_count;
+    SOCKET fd_array[MAX_SOCKETS];
+};
+
+/* read, write and oob sets of all sockets a dispatcher waits on */
+struct sel_engine {
+    struct sock_set armed[3];
+    struct sock_set ready[3];
+    int added;
+};
+
+/* hidden window that services all async requests of a task */
+struct dispatcher {
+    HWND hWnd;
+    struct async_base *head;
+    struct async_base *tail;
+    int depth;
+    int kicked;
+    UINT timer;
+    UINT interval;
+    int spin;
+    int events;
+    int budget;                 /* posts left in this run */
+    int hot;                    /* counted in hot_disps */
+    int yield;                  /* over budget, continue on the timer */
+    struct async_base *resume;  /* where the next run starts */
+    int count;                  /* requests queued */
+    int dns_wait;               /* lookups waiting on the resolver socket */
+    struct ows_task_stats st;
+    struct sel_engine *sel;
+};
+
+struct async_base {
+    struct async_base *next;
+    struct dispatcher *disp;
+    int aid;
+    int (*handler)(struct async_base *arg);
+    int cancel;
+    int closed;
+    int busy;
+    int done;
+};
+
+/* flushes the task's combined writes on the next dispatcher run */
+struct per_flush {
+    struct async_base base;
+    struct per_task *task;
+    int queued;
+};
 
 struct per_task {
+    struct per_task *next;
     HTASK task;
+    int refs;
     FARPROC BlockingHook;
     int cancel;
     int blocking;
+    SOCKET blk_sock;            /* what a blocking call waits for */
+    long blk_ev;
+    int blk_idle;
+    struct async_base *blk_lookup;  /* reverse lookup waiting in libd2sock */
+    char *iov_buf;              /* OWSSendV/OWSRecvV bounce buffer */
+    struct per_flush flush;
+    struct wcomb *wc_head;      /* sockets with combined writes pending */
+    int wc_pass;
     int wsa_err;
+    int dead;                   /* cleaned up, freed once off the stack */
+    struct dispatcher disp;
+    char hostbuf[MAXGETHOSTSTRUCT];
 };
-#define MAX_TASKS 10
-struct per_task tasks[MAX_TASKS];
-static int num_tasks;
+/* Tasks are hashed by HTASK, with the last one found cached in front:
+ * the same app usually makes many calls in a row. */
+#define TASK_HASH 16
+#define TASK_HASH_M1 (TASK_HASH - 1)
+static struct per_task *tasks[TASK_HASH];
+static struct per_task *last_task;
 
 static HINSTANCE hinst;
 static const char *WSAClassName = "OpenWinsock WSA Window";
+static const char *IniSection = "OpenWinsock";
+
+/* Poll interval bounds, WIN.INI [OpenWinsock] PollMin/PollMax/PollSpin.
+ * Win16 timers tick at 55ms, so right after activity the dispatcher
+ * re-polls PollSpin times by posting to itself before using a timer. */
+static UINT poll_min = 55;
+static UINT poll_max = 500;
+static int poll_spin = 4;
+
+/* Fairness: a dispatcher run posts at most EventBudget notifications,
+ * split between the tasks that had events to post or left some for
+ * later in their last run. When other such tasks are waiting, the rest
+ * is left to the timer, so the task's queue runs dry and Windows lets
+ * the others run. Tasks whose requests are all idle don't count.
+ * WIN.INI [OpenWinsock] EventBudget, 0 for no limit, and TaskQueue,
+ * requests one task may have queued, 0 for no limit. */
+static int ev_budget = 32;
+static int task_queue;
+static int hot_disps;           /* dispatchers with events last run */
+
+/* With no messages to pump, a blocking call sleeps on its socket for
+ * up to BlockWait ms at a time instead of spinning PeekMessage(). */
+static int blk_wait = 20;
+
+/* Read-ahead: a small recv() on a stream socket pulls up to ReadAhead
+ * bytes in one host call and is served from memory until they run out.
+ * select(), FIONREAD and the dispatcher count them as data to read.
+ * WIN.INI [OpenWinsock] ReadAhead=<bytes>, 0 disables. */
+struct rdahead {
+    int head;
+    int tail;
+    int busy;                   /* filling, the hook may close the socket */
+    int dead;
+    char data[1];
+};
+static int ra_size = 1024;
+#define RA_MAX 16384
+
+/* Write combining: small send()s on a stream socket are buffered and go
+ * to the host together, when WriteCombine bytes are buffered, on the
+ * next dispatcher run (the app is back to its message loop), or before
+ * any recv(), select(), shutdown() or closesocket(). TCP_NODELAY turns
+ * it off for the socket. An error of a deferred flush is reported by
+ * the next send(). WIN.INI [OpenWinsock] WriteCombine=<bytes>, 0 disables. */
+struct wcomb {
+    struct wcomb *next;         /* on the task's pending list */
+    struct per_task *task;      /* NULL if not pending */
+    SOCKET s;
+    int len;
+    int busy;
+    int dead;
+    int closing;                /* closed by the app, see wc_close() */
+    int err;                    /* errno of a failed deferred flush */
+    int pass;
+    char data[1];
+};
+static int wc_size = 1024;
+
+/* UDP receive queue: once a non-blocking datagram socket gets one from
+ * the host, the ones waiting behind it are pulled in the same pass and
+ * kept with their source addresses. recvfrom(), FIONREAD, select() and
+ * FD_READ are then served from memory. A pass is as long as the last
+ * one proved useful, so a quiet socket costs at most one extra call.
+ * WIN.INI [OpenWinsock] UdpQueue=<bytes>, 0 disables. */
+struct dgram {
+    int len;
+    int err;                    /* EMSGSIZE if truncated */
+    struct sockaddr_in from;
+};
+struct udpq {
+    int head;
+    int tail;
+    int count;
+    int burst;
+    struct dgram *held;         /* didn't fit, served after the others */
+    char data[1];
+};
+static int uq_size = 8192;
+static char *uq_buf;            /* MaxUdpDg bytes a datagram is read into */
+#define UQ_BURST 32
+
+/* Query answers: apps ask far more often than anything changes, so
+ * options once read, the local and peer address and FIONREAD are kept
+ * and dropped by the calls that change them or when the socket turns
+ * readable. FIONREAD is also only good for FionreadTTL ms, as data may
+ * arrive without a readiness check seeing it.
+ * WIN.INI [OpenWinsock] FionreadTTL=<ms>, 0 disables that part. */
+#define SC_NOPT 11
+struct sockc {
+    WORD opts;                  /* valid optval[] entries, sc_opts[] bits */
+    BYTE optlen[SC_NOPT];
+    long optval[SC_NOPT];
+    int namelen;                /* 0 if not known */
+    int peerlen;
+    struct sockaddr_in name;
+    struct sockaddr_in peer;
+    int nr_ok;
+    u_long nread;               /* from the host, read-ahead not included */
+    DWORD stamp;
+};
+#define SC_NAME 1
+#define SC_PEER 2
+#define SC_NREAD 4
+static UINT nr_ttl = 55;
+
+/* What the DLL knows about a socket, indexed by SOCKET and cleared by
+ * closesocket(). The fields the dispatcher sweeps on every poll are
+ * packed byte arrays, FD_* bits all fit in a byte. */
+#define SF_PROBED 1             /* SO_TYPE checked */
+#define SF_STREAM 2
+#define SF_NODELAY 4            /* TCP_NODELAY, don't combine writes */
+#define SF_NBIO 8               /* FIONBIO or WSAAsyncSelect() */
+#define SF_NBKNOWN 16           /* SF_NBIO is what the host has */
+#define SF_LINGER 32            /* SO_LINGER with a timeout */
+#define SF_ABORT 64             /* SO_LINGER with no timeout, a reset */
+static struct {
+    BYTE flags[MAX_SOCKETS];    /* SF_* */
+    BYTE armed[MAX_SOCKETS];    /* lEvent bits not posted since re-enabled */
+    BYTE polled[MAX_SOCKETS];   /* in the dispatcher's select sets */
+    BYTE revents[MAX_SOCKETS];  /* readiness seen by the last poll */
+    WORD since[MAX_SOCKETS];    /* tick revents was first set */
+    WORD asel[MAX_SOCKETS];     /* asel_pool index + 1, 0 if none */
+    HTASK task[MAX_SOCKETS];    /* owner, 0 if not created through us */
+    struct rdahead *ra[MAX_SOCKETS];
+    struct wcomb *wc[MAX_SOCKETS];
+    struct udpq *uq[MAX_SOCKETS];
+    struct sockc *sc[MAX_SOCKETS];
+} socks;
+#define SOCK_OK(s) ((s) < MAX_SOCKETS)
+#define RA_LEN(s) (SOCK_OK(s) && socks.ra[s] ? \
+        socks.ra[s]->tail - socks.ra[s]->head : 0)
+#define UQ_LEN(s) (SOCK_OK(s) && socks.uq[s] ? \
+        socks.uq[s]->count + !!socks.uq[s]->held : 0)
+
+/* WIN.INI [OpenWinsock] MaxUdpDg, what the host stack takes */
+static int max_udp_dg = 32767;
+
+/* Resolved names, case-folded, and reverse lookups keyed by dotted
+ * address, with a TTL. Names a DnsServer reply says don't exist, or
+ * have no address, are kept for a shorter while with that error.
+ * libd2sock gives no reason when a lookup fails, so a failure may be
+ * a timeout as well, and those aren't kept. WIN.INI [OpenWinsock] DnsCache, DnsRevCache, DnsTTL and DnsNegTTL
+ * set the number of entries and the TTLs in seconds. */
+struct dns_entry {
+    char FAR *name;
+    struct hostent FAR *he;     /* packed, NULL if negative */
+    int err;                    /* of a negative entry */
+    DWORD stamp;
+    DWORD ttl;
+    DWORD used;
+};
+struct dns_cache {
+    struct dns_entry *ent;
+    struct ows_dns_stats st;
+};
+static struct dns_cache dns_fwd = { NULL, { 0, 0, 0, 16 } };
+static struct dns_cache dns_rev = { NULL, { 0, 0, 0, 16 } };
+static DWORD dns_ttl = 300;
+static DWORD dns_neg_ttl = 30;
+static DWORD dns_clock;
 
 struct GHBN {
     HWND hWnd;
     u_int wMsg;
-    const char FAR *name;
+    char *name;                 /* own copy, queries may be sent again */
+    char addr[16];
+    int len;
+    int type;
     char FAR *buf;
     int buflen;
     HANDLE id;
-};
-
-struct async_base {
-    int aid;
-    int (*handler)(struct async_base *arg);
-    int cancel;
-    int closed;
+    /* lookups run by the resolver engine */
+    int tries;                  /* queries sent, 0 if not queried */
+    int answered;
+    DWORD start;
+    DWORD sent;                 /* last query */
+    WORD qid;                   /* its ID */
+    UINT wait;                  /* until the query is sent again, ms */
 };
 
 struct per_asel {
@@ -67,15 +307,120 @@ struct per_async {
     struct async_base base;
     struct GHBN ghbn;
 };
-#define MAX_ASYNC 256
-static struct per_async asyncs[MAX_ASYNC];
-static HANDLE wsa_id;
-#define MAX_ASYNC_M1 (MAX_ASYNC - 1)
 
-enum { I_ASYNC, I_ASEL };
+/* Async request handles: the low bits index a slot, the high bits carry
+ * the slot's generation, so a stale handle never matches a reused slot.
+ * The table grows on demand; records are allocated per slot and kept,
+ * so a record's address is stable while its request is in flight. */
+#define ASYNC_IDX_BITS 10
+#define ASYNC_MAX ((1 << ASYNC_IDX_BITS) - 1)
+#define ASYNC_GEN_M1 ((1 << (16 - ASYNC_IDX_BITS)) - 1)
+#define ASYNC_HANDLE(i, g) ((HANDLE)(((g) << ASYNC_IDX_BITS) | ((i) + 1)))
+#define ASYNC_IDX(h) ((int)((h) & ASYNC_MAX) - 1)
+#define ASYNC_GEN(h) (((h) >> ASYNC_IDX_BITS) & ASYNC_GEN_M1)
+
+struct async_slot {
+    struct per_async *async;
+    int next_free;
+    BYTE gen;
+    BYTE used;
+    BYTE cancelled;             /* freed by a cancel, not by the reply */
+};
+static struct async_slot *async_tab;
+static int async_cnt;
+static int async_free = -1;
+static int async_imm;           /* generation of slotless handles */
+
+enum { I_ASYNC, I_ASEL, I_FLUSH };
+
+/* Fixed-size records carved out of one shared global segment, so
+ * frequent re-registrations don't fragment the small local heap. */
+struct pool {
+    HGLOBAL hmem;
+    char FAR *mem;
+    void FAR *free;
+    unsigned size;
+    struct ows_pool_stats st;
+};
+
+static struct pool asel_pool = { 0, NULL, NULL,
+        sizeof(struct per_asel), { MAX_SOCKETS } };
 
 static void CancelAS(int s);
 
+static int async_slot_alloc(void)
+{
+    int i;
+
+    if (async_free < 0) {
+        int n = async_cnt ? async_cnt * 2 : 16;
+        struct async_slot *tab;
+
+        if (n > ASYNC_MAX)
+            n = ASYNC_MAX;
+        if (n == async_cnt)
+            return -1;
+        tab = realloc(async_tab, n * sizeof(struct async_slot));
+        if (!tab)
+            return -1;
+        memset(tab + async_cnt, 0, (n - async_cnt) * sizeof(struct async_slot));
+        for (i = n - 1; i >= async_cnt; i--) {
+            tab[i].next_free = async_free;
+            async_free = i;
+        }
+        async_tab = tab;
+        async_cnt = n;
+    }
+    i = async_free;
+    assert(i >= 0);
+    async_free = async_tab[i].next_free;
+    async_tab[i].gen = (async_tab[i].gen + 1) & ASYNC_GEN_M1;
+    async_tab[i].used = 1;
+    async_tab[i].cancelled = 0;
+    return i;
+}
+
+static void async_slot_free(int i)
+{
+    assert(async_tab[i].used);
+    async_tab[i].used = 0;
+    async_tab[i].next_free = async_free;
+    async_free = i;
+}
+
+/* slot of a handle, NULL if the handle is unknown, stale or cancelled.
+ * A slot that is not in use is one of a request already answered, so
+ * are handles with no slot at all, see async_id(). */
+static struct async_slot *async_slot_find(HANDLE h)
+{
+    int i = ASYNC_IDX(h);
+
+    if (i < 0 || i >= async_cnt || async_tab[i].gen != ASYNC_GEN(h) ||
+            async_tab[i].cancelled)
+        return NULL;
+    return &async_tab[i];
+}
+
+static void async_slots_done(void)
+{
+    int i;
+
+    for (i = 0; i < async_cnt; i++)
+        free(async_tab[i].async);
+    free(async_tab);
+    async_tab = NULL;
+    async_cnt = 0;
+    async_free = -1;
+}
+static void dns_flush(struct dns_cache *cache);
+static void dns_init(void);
+static void netdb_unload(void);
+static void sock_done(void);
+static void sock_drop_task(HTASK task);
+static void sock_free(SOCKET s);
+static void sc_drop(SOCKET s, int what);
+static void wc_drop_task(struct per_task *task);
+
 #ifdef DEBUG
 static int idComm;
 
@@ -95,44 +440,196 @@ static void debug_out(const char *msg)
 #define DEBUG_STR(...)
 #endif
 
-#define _ENT() debug_out("enter: " __FUNCTION__ "\n")
-#define _LVE() debug_out("leave: " __FUNCTION__ "\n")
+/*
+ * Binary trace: fixed-size records in a ring, formatting is left to
+ * owstrace.py. Cheap enough to stay on in release builds, enabled by
+ * WIN.INI [OpenWinsock] Trace=<records>. OWSDumpTrace() drains it.
+ * owstrace.py parses this enum, keep one event per line.
+ */
+enum {
+    TR_ENTER = 1,       /* function entry, by line */
+    TR_LEAVE,           /* function exit, by line */
+    TR_POST,            /* s: hWnd, a1: wMsg, a2: lParam */
+    TR_POLL,            /* a1: select() result */
+    TR_TIMER,           /* a1: poll interval, 0 if killed */
+    TR_ASEL,            /* s: socket, a2: lEvent */
+    TR_RECV,            /* s: socket, a1: result */
+    TR_SEND,            /* s: socket, a1: result */
+    TR_ERR,             /* a1: WSA error */
+};
+
+struct trace_rec {
+    DWORD tick;
+    WORD ev;
+    WORD line;
+    WORD s;
+    WORD a1;
+    DWORD a2;
+};
+
+struct trace_hdr {
+    char magic[4];      /* "OWST" */
+    WORD version;
+    WORD recsize;
+    WORD count;         /* records following */
+    WORD pad;
+    DWORD total;        /* records ever written */
+};
+
+#define TRACE_MAX 2048  /* 32K, fits one _lwrite() */
+
+static struct {
+    HGLOBAL hmem;
+    struct trace_rec FAR *recs;
+    unsigned mask;
+    unsigned head;
+    DWORD total;
+} trace;
+
+static void trace_put(int ev, int line, int s, int a1, long a2)
+{
+    struct trace_rec FAR *r = &trace.recs[trace.head++ & trace.mask];
+
+    r->tick = GetTickCount();
+    r->ev = ev;
+    r->line = line;
+    r->s = s;
+    r->a1 = a1;
+    r->a2 = a2;
+    trace.total++;
+}
+
+#define TRACE(ev, s, a1, a2) \
+        (trace.recs ? trace_put(ev, __LINE__, s, a1, a2) : (void)0)
+
+#define _ENT() { \
+        TRACE(TR_ENTER, 0, 0, 0); \
+        debug_out("enter: " __FUNCTION__ "\n"); \
+}
+#define _LVE() { \
+        TRACE(TR_LEAVE, 0, 0, 0); \
+        debug_out("leave: " __FUNCTION__ "\n"); \
+}
+
+static void trace_init(int n)
+{
+    unsigned size = 1;
+
+    if (n <= 0)
+        return;
+    while (size < n && size < TRACE_MAX)
+        size <<= 1;
+    trace.hmem = GlobalAlloc(GPTR | GMEM_SHARE,
+            (DWORD)size * sizeof(struct trace_rec));
+    if (!trace.hmem)
+        return;
+    trace.recs = (struct trace_rec FAR *)GlobalLock(trace.hmem);
+    trace.mask = size - 1;
+}
+
+static void trace_done(void)
+{
+    if (!trace.hmem)
+        return;
+    GlobalUnlock(trace.hmem);
+    GlobalFree(trace.hmem);
+    memset(&trace, 0, sizeof(trace));
+}
+
+/* always-on counters, see OWSGetStats() */
+static struct ows_stats stats;
+static const DWORD stat_bounds[OWS_HIST_BUCKETS - 1] =
+        { 0, 55, 110, 220, 440, 880, 1760 };
+
+static void stat_time(int api, DWORD start)
+{
+    struct ows_api_stats *a = &stats.api[api];
+    DWORD ms = GetTickCount() - start;
+    int b;
+
+    a->calls++;
+    a->total_ms += ms;
+    if (ms > a->max_ms)
+        a->max_ms = ms;
+    for (b = 0; b < OWS_HIST_BUCKETS - 1 && ms > stat_bounds[b]; b++);
+    a->hist[b]++;
+}
+
+#define stat_call(id) (stats.api[id].calls++)
 
 #define _WSAE(x) errno = 0, (x)
 
-static void task_alloc(HTASK task)
+/* selectors have the RPL and TI bits at the bottom */
+#define task_hash(t) ((((unsigned)(t)) >> 3) & TASK_HASH_M1)
+
+static int ntasks;
+
+static struct per_task *task_alloc(HTASK task)
 {
     struct per_task *ret;
-    int i;
+    unsigned h = task_hash(task);
 
     assert(task);
-    for (i = 0; i < num_tasks; i++) {
-        if (!tasks[i].task)
-            break;
-    }
-    if (i == num_tasks) {
-        assert(num_tasks < MAX_TASKS);
-        num_tasks++;
-    }
-    ret = &tasks[i];
+    ret = malloc(sizeof(*ret));
+    if (!ret)
+        return NULL;
     memset(ret, 0, sizeof(*ret));
     ret->task = task;
+    ret->refs = 1;
+    ret->blk_sock = INVALID_SOCKET;
+    ret->next = tasks[h];
+    tasks[h] = ret;
+    ntasks++;
+    return ret;
+}
+
+static void disp_destroy(struct dispatcher *disp);
+static void dns_done(void);
+
+/* the last part of task_free(), once no request is on the stack */
+static void task_reap(struct per_task *task)
+{
+    disp_destroy(&task->disp);
+    if (task->disp.hWnd)
+        return;
+    free(task->iov_buf);
+    free(task);
+    if (!--ntasks)
+        dns_done();
 }
 
 static void task_free(struct per_task *task)
 {
-    task->task = NULL;
-    while (num_tasks && !tasks[num_tasks - 1].task)
-        num_tasks--;
+    struct per_task **p = &tasks[task_hash(task->task)];
+
+    disp_destroy(&task->disp);
+    sock_drop_task(task->task);
+    while (*p != task)
+        p = &(*p)->next;
+    *p = task->next;
+    if (last_task == task)
+        last_task = NULL;
+    wc_drop_task(task);
+    /* WSACleanup() from inside a request, e.g. from the blocking hook
+     * of a lookup: WSAWindowProc() finishes this when the run is over */
+    if (task->disp.hWnd) {
+        task->dead++;
+        return;
+    }
+    task_reap(task);
 }
 
 static struct per_task *task_find(HTASK task)
 {
-    int i;
+    struct per_task *t;
 
-    for (i = 0; i < num_tasks; i++) {
-	if (tasks[i].task == task)
-	    return &tasks[i];
+    if (last_task && last_task->task == task)
+        return last_task;
+    for (t = tasks[task_hash(task)]; t; t = t->next) {
+        if (t->task == task) {
+            last_task = t;
+            return t;
+        }
     }
     return NULL;
 }
@@ -159,7 +656,7 @@ static BOOL DefaultBlockingHook(void)
     MSG msg;
     BOOL ret;
 
-    ret = PeekMessage(&msg, NULL, 0, 0, PM_REMOVE);
+    ret = PeekMessage(&msg, 0, 0, 0, PM_REMOVE);
     if (ret) {
        TranslateMessage(&msg);
        DispatchMessage(&msg);
@@ -182,15 +679,52 @@ static int blk_async(struct async_base *async)
     return 1;
 }
 
+/* Wait for the blocked call's socket, or a timeout to pump messages
+ * again. libd2sock may call the hook from select() itself: then just
+ * pump, the outer wait is still in progress. */
+static void blk_sleep(struct per_task *task)
+{
+    fd_set fds;
+    struct timeval tv;
+
+    if (task->blk_sock == INVALID_SOCKET || blk_wait <= 0)
+        return;
+    FD_ZERO(&fds);
+    FD_SET(task->blk_sock, &fds);
+    tv.tv_sec = blk_wait / 1000;
+    tv.tv_usec = (blk_wait % 1000) * 1000L;
+    task->blk_idle++;
+    select(task->blk_sock + 1, (task->blk_ev & FD_READ) ? &fds : NULL,
+            (task->blk_ev & FD_WRITE) ? &fds : NULL, NULL, &tv);
+    task->blk_idle--;
+}
+
 static int blk_func(void *arg)
 {
     struct per_task *task;
+    int ret;
 
+    stats.hooks++;
     if (arg)
         return blk_async(arg);
 
     task = task_find(GetCurrentTask());
-    assert(task);
+    /* cleaned up from inside a request, nothing may wait any more */
+    if (!task)
+        return 0;
+    /* gethostbyaddr() has no arg for the hook. The lookup is hidden
+     * while it pumps, so what the app calls from there blocks as usual. */
+    if (task->blk_lookup) {
+        arg = task->blk_lookup;
+        task->blk_lookup = NULL;
+        ret = blk_async(arg);
+        task->blk_lookup = arg;
+        return ret;
+    }
+    if (task->blk_idle) {
+        DefaultBlockingHook();
+        return 1;
+    }
     if (task->blocking) {
         _WSAE(task->wsa_err) = WSAEINPROGRESS;
         return 0;  // avoid recursive blocking
@@ -198,8 +732,8 @@ static int blk_func(void *arg)
     task->blocking++;
     if (task->BlockingHook)
         while (task->BlockingHook());
-    else
-        DefaultBlockingHook();
+    else if (!DefaultBlockingHook())
+        blk_sleep(task);
     task->blocking--;
     /* check for WSACancelBlockingCall() */
     if (task->cancel) {
@@ -219,592 +753,3749 @@ static int close_func(int s, void *arg)
     return 0;  // no close
 }
 
-/* callback needs to be exported so that Windows can patch its prolog
- * with proper dataseg - same that it passes to LibMain() */
-LRESULT CALLBACK _export WSAWindowProc(HWND hWnd, UINT wMsg,
-        WPARAM wParam, LPARAM lParam)
+static int pool_init(struct pool *pool)
 {
-    _ENT();
-    switch (wMsg) {
-    case WM_USER:
-        switch (wParam) {
-            case 0: {
-                struct async_base *async = (struct async_base *)lParam;
-                int rc;
-
-                DEBUG_STR("\tASYNC event %i\n", async->aid);
-                assert(async && async->handler);
-                rc = async->handler(async);
-                if (rc) {
-                    DestroyWindow(hWnd);
-                } else {
-#define USE_TIMER 1
-#if USE_TIMER
-                    SetWindowLong(hWnd, 0, lParam);
-                    SetTimer(hWnd, 1, 500, NULL);
-                    debug_out("setting timer\n");
-#else
-                    while (DefaultBlockingHook());
-                    PostMessage(hWnd, wMsg, wParam, lParam);
-#endif
-                }
-                break;
-            }
-        }
-        break;
+    char FAR *p;
+    int i;
 
-    case WM_TIMER:
-        DEBUG_STR("fired timer %i\n", wParam);
-        KillTimer(hWnd, wParam);
-        PostMessage(hWnd, WM_USER, 0, GetWindowLong(hWnd, 0));
-        break;
+    pool->hmem = GlobalAlloc(GPTR | GMEM_SHARE,
+            (DWORD)pool->size * pool->st.size);
+    if (!pool->hmem)
+        return -1;
+    pool->mem = GlobalLock(pool->hmem);
+    /* thread the free list through the unused records */
+    for (i = 0, p = pool->mem; i < pool->st.size - 1; i++, p += pool->size)
+        *(void FAR **)p = p + pool->size;
+    *(void FAR **)p = NULL;
+    pool->free = pool->mem;
+    return 0;
+}
 
-    default:
-        DEBUG_STR("\twmsg 0x%x\n", wMsg);
-        return DefWindowProc(hWnd, wMsg, wParam, lParam);
+static void FAR *pool_alloc(struct pool *pool)
+{
+    void FAR *ret;
+
+    if (!pool->mem && pool_init(pool))
+        return NULL;
+    ret = pool->free;
+    if (!ret) {
+        pool->st.fails++;
+        return NULL;
     }
+    pool->free = *(void FAR **)ret;
+    memset(ret, 0, pool->size);
+    pool->st.used++;
+    if (pool->st.used > pool->st.hwm)
+        pool->st.hwm = pool->st.used;
+    return ret;
+}
 
-    return 0;
+static void pool_free(struct pool *pool, void FAR *p)
+{
+    *(void FAR **)p = pool->free;
+    pool->free = p;
+    pool->st.used--;
 }
 
-BOOL FAR PASCAL LibMain(HINSTANCE hInstance, WORD wDataSegment,
-			WORD wHeapSize, LPSTR lpszCmdLine)
+/* records are referred to by index where a pointer won't fit */
+static int pool_idx(struct pool *pool, void FAR *p)
 {
-    WNDCLASS wc = {0};
+    return (int)(((char FAR *)p - pool->mem) / pool->size);
+}
 
-#ifdef DEBUG
-    idComm = OpenComm("COM4", 16384, 16384);
-#endif
-    _ENT();
-    DEBUG_STR("hInstance=%x dataseg=%x heapsize=%x cmdline=%s\n",
-            hInstance, wDataSegment, wHeapSize, lpszCmdLine);
-    d2s_set_blocking_hook(blk_func);
-#ifdef DEBUG
-    d2s_set_debug_hook(debug_out);
-#endif
-    d2s_set_close_hook(close_func);
-    hinst = hInstance;
+static void FAR *pool_ptr(struct pool *pool, int i)
+{
+    return pool->mem + (unsigned)i * pool->size;
+}
 
-    wc.style = 0;
-    wc.lpfnWndProc = WSAWindowProc;
-    wc.cbWndExtra = sizeof(long);
-    wc.hInstance = hInstance;
-    wc.lpszClassName = WSAClassName;
-    RegisterClass(&wc);
-    return 1;
+static void pool_done(struct pool *pool)
+{
+    if (!pool->hmem)
+        return;
+    DEBUG_STR("pool of %i: hwm %i, fails %i\n", pool->st.size,
+            pool->st.hwm, pool->st.fails);
+    GlobalUnlock(pool->hmem);
+    GlobalFree(pool->hmem);
+    pool->hmem = 0;
+    pool->mem = NULL;
+    pool->free = NULL;
 }
 
-#pragma off (unreferenced);
-int FAR PASCAL WEP(int nParameter)
-#pragma on (unreferenced);
+static void async_cancel(struct async_base *async)
 {
-    _ENT();
-    d2s_set_blocking_hook(NULL);
-    d2s_set_debug_hook(NULL);
-#ifdef DEBUG
-    if (idComm > 0)
-	CloseComm(idComm);
-#endif
-    return (1);
+    switch (async->aid) {
+    case I_ASEL:
+        CancelAS(((struct per_asel *)async)->s);
+        break;
+    default:
+        async->cancel++;
+        break;
+    }
 }
 
-HANDLE pascal far WSAAsyncGetServByName(HWND hWnd, u_int wMsg,
-					const char FAR *name,
-					const char FAR *proto,
-					char FAR *buf, int buflen)
+static void async_release(struct async_base *async)
 {
-    struct per_task *task = task_find(GetCurrentTask());
+    switch (async->aid) {
+    case I_ASYNC: {
+        struct per_async *arg = (struct per_async *)async;
+        int i = ASYNC_IDX(arg->ghbn.id);
 
-    _ENT();
-    assert(task);
-    /* Not supported */
-    _WSAE(task->wsa_err) = WSAEOPNOTSUPP;
-    return 0;
+        free(arg->ghbn.name);
+        /* the record stays with its slot for reuse, unless a cancel
+         * already gave the slot away */
+        if (async_tab[i].async == arg)
+            async_slot_free(i);
+        else
+            free(arg);
+        break;
+    }
+    case I_ASEL:
+        pool_free(&asel_pool, async);
+        break;
+    case I_FLUSH:
+        /* embedded in per_task, may be queued again */
+        ((struct per_flush *)async)->queued = 0;
+        break;
+    }
 }
 
-HANDLE pascal far WSAAsyncGetServByPort(HWND hWnd, u_int wMsg, int port,
-					const char FAR *proto,
-					char FAR *buf, int buflen)
+static void disp_kick(struct dispatcher *disp)
 {
-    struct per_task *task = task_find(GetCurrentTask());
+    if (disp->kicked || disp->yield)
+        return;
+    stats.kicks++;
+    if (PostMessage(disp->hWnd, WM_USER, 0, 0)) {
+        disp->kicked++;
+        return;
+    }
+    /* the queue is full, the timer has to do */
+    if (!disp->timer) {
+        disp->timer = poll_min;
+        SetTimer(disp->hWnd, 1, disp->timer, NULL);
+        stats.timer_sets++;
+    }
+}
 
-    _ENT();
-    assert(task);
-    /* Not supported */
-    _WSAE(task->wsa_err) = WSAEOPNOTSUPP;
-    return 0;
+static void disp_set_hot(struct dispatcher *disp, int hot)
+{
+    hot = !!hot;
+    if (disp->hot != hot) {
+        disp->hot = hot;
+        hot_disps += hot ? 1 : -1;
+    }
 }
 
-HANDLE pascal far WSAAsyncGetProtoByName(HWND hWnd, u_int wMsg,
-					 const char FAR *name,
-					 char FAR *buf, int buflen)
+/* Unlink finished requests. Only safe when no handler is on the stack,
+ * as the handlers may pump messages and re-enter disp_run(). */
+static void disp_reap(struct dispatcher *disp)
 {
-    struct per_task *task = task_find(GetCurrentTask());
+    struct async_base **p = &disp->head;
+    struct async_base *async;
 
-    _ENT();
-    assert(task);
-    /* Not supported */
-    _WSAE(task->wsa_err) = WSAEOPNOTSUPP;
-    return 0;
+    disp->tail = NULL;
+    while ((async = *p)) {
+        if (async->done) {
+            *p = async->next;
+            async_release(async);
+            stats.queue--;
+            if (!--disp->count)
+                disp_set_hot(disp, 0);
+        } else {
+            disp->tail = async;
+            p = &async->next;
+        }
+    }
 }
 
-HANDLE pascal far WSAAsyncGetProtoByNumber(HWND hWnd, u_int wMsg,
-					   int number, char FAR *buf,
-					   int buflen)
+/* Round robin: the next run starts with what this one had no budget
+ * left for. Same constraints as disp_reap(). */
+static void disp_rotate(struct dispatcher *disp)
 {
-    struct per_task *task = task_find(GetCurrentTask());
+    struct async_base *first = disp->resume;
+    struct async_base *last;
 
-    _ENT();
-    assert(task);
-    /* Not supported */
-    _WSAE(task->wsa_err) = WSAEOPNOTSUPP;
-    return 0;
+    disp->resume = NULL;
+    if (!first || first == disp->head)
+        return;
+    for (last = disp->head; last->next != first; last = last->next);
+    last->next = NULL;
+    disp->tail->next = disp->head;
+    disp->head = first;
+    disp->tail = last;
 }
 
-#define GHBN_RET(g, l) \
-        PostMessage(g->hWnd, g->wMsg, g->id, WSAMAKEASYNCREPLY(l, 0));
-#define GHBN_ERR(g, e) \
-        PostMessage(g->hWnd, g->wMsg, g->id, WSAMAKEASYNCREPLY(0, e));
+static const long sel_ev[3] = { FD_READ, FD_WRITE, FD_OOB };
 
-static void _AsyncGetHostByName(struct async_base *base)
+static void sset_add(struct sock_set *set, SOCKET s)
 {
-    struct per_async *arg = (struct per_async *)base;
-    struct GHBN *ghbn = &arg->ghbn;
-    struct hostent *he;
-    int len, i;
-    char FAR **aliases;
-    char FAR **h;
-    struct hostent FAR *dst = (struct hostent FAR *)ghbn->buf;
-    char FAR *dstart = ghbn->buf + sizeof(struct hostent);
-    char FAR *data = dstart;
-    int buflen = ghbn->buflen;
-    int done_len = 0;
+    assert(set->fd_count < MAX_SOCKETS);
+    set->fd_array[set->fd_count++] = s;
+}
 
-    he = gethostbyname_ex(ghbn->name, arg);
-    if (!he) {
-        GHBN_ERR(ghbn, WSAHOST_NOT_FOUND);
+static void sset_del(struct sock_set *set, SOCKET s)
+{
+    u_int i;
+
+    for (i = 0; i < set->fd_count; i++) {
+        if (set->fd_array[i] == s) {
+            set->fd_array[i] = set->fd_array[--set->fd_count];
+            return;
+        }
+    }
+}
+
+/* keep the dispatcher's select sets in sync with what asel waits for */
+static void asel_poll(struct per_asel *asel, long events)
+{
+    struct sel_engine *sel = asel->base.disp->sel;
+    long diff = events ^ socks.polled[asel->s];
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        if (!(diff & sel_ev[i]))
+            continue;
+        if (events & sel_ev[i]) {
+            sset_add(&sel->armed[i], asel->s);
+            sel->added++;
+        } else {
+            sset_del(&sel->armed[i], asel->s);
+        }
+    }
+    socks.polled[asel->s] = events;
+}
+
+/* the live registration of a socket, NULL if none */
+static struct per_asel *sock_asel(SOCKET s)
+{
+    if (!SOCK_OK(s) || !socks.asel[s])
+        return NULL;
+    return pool_ptr(&asel_pool, socks.asel[s] - 1);
+}
+
+/* One select() for all armed sockets, results go to the owners. */
+static void disp_poll(struct dispatcher *disp)
+{
+    struct sel_engine *sel = disp->sel;
+    fd_set *fds[3];
+    struct timeval tv = {0};
+    int i, res, nfds = 0;
+    u_int j;
+
+    for (i = 0; i < 3; i++) {
+        struct sock_set *armed = &sel->armed[i];
+        struct sock_set *ready = &sel->ready[i];
+
+        ready->fd_count = 0;
+        for (j = 0; j < armed->fd_count; j++) {
+            SOCKET s = armed->fd_array[j];
+
+            /* data read ahead or queued is there without asking */
+            if (i == 0 && (RA_LEN(s) || UQ_LEN(s))) {
+                if (!socks.revents[s])
+                    socks.since[s] = (WORD)GetTickCount();
+                socks.revents[s] |= FD_READ;
+                continue;
+            }
+            ready->fd_array[ready->fd_count++] = s;
+            if (s >= nfds)
+                nfds = s + 1;
+        }
+        fds[i] = ready->fd_count ? (fd_set *)ready : NULL;
+    }
+    if (!nfds)
+        return;
+    res = select(nfds, fds[0], fds[1], fds[2], &tv);
+    TRACE(TR_POLL, 0, res, 0);
+    stats.polls++;
+    if (res <= 0)
         return;
+    for (i = 0; i < 3; i++) {
+        if (!fds[i])
+            continue;
+        for (j = 0; j < sel->ready[i].fd_count; j++) {
+            SOCKET s = sel->ready[i].fd_array[j];
+
+            if (!socks.revents[s])
+                socks.since[s] = (WORD)GetTickCount();
+            socks.revents[s] |= sel_ev[i];
+            if (i == 0)
+                sc_drop(s, SC_NREAD | SC_PEER);
+        }
     }
-    len = sizeof(struct hostent);
-    memcpy(dst, he, len);
-    buflen -= len;
-    done_len += len;
+}
 
-    len = strlen(he->h_name) + 1;
-    assert(len <= buflen);
-    memcpy(data, he->h_name, len);
-    dst->h_name = data;
-    data += len;
-    buflen -= len;
-    done_len += len;
-
-#define MAXALIASES      8
-    aliases = (char FAR **)data;
-    dst->h_aliases = aliases;
-    len = sizeof(char FAR *) * (MAXALIASES + 1);
-    assert(len <= buflen);
-    memset(data, 0, len);
-    data += len;
-    buflen -= len;
-    done_len += len;
-
-    for (h = he->h_aliases; *h && (h < he->h_aliases + MAXALIASES); h++, aliases++) {
-        len = strlen(*h) + 1;
-        assert(len <= buflen);
-        memcpy(data, *h, len);
-        *aliases = data;
-        data += len;
-        buflen -= len;
-        done_len += len;
-    }
-    *aliases = NULL;
-
-#define MAXADDRS        8
-    aliases = (char FAR **)data;
-    dst->h_addr_list = aliases;
-    len = sizeof(char FAR *) * (MAXADDRS + 1);
-    assert(len <= buflen);
-    memset(data, 0, len);
-    data += len;
-    buflen -= len;
-    done_len += len;
-
-    len = he->h_length;
-    for (h = he->h_addr_list; *h && (h < he->h_addr_list + MAXADDRS); h++, aliases++) {
-        assert(len <= buflen);
-        memcpy(data, *h, len);
-        *aliases = data;
-        data += len;
-        buflen -= len;
-        done_len += len;
-    }
-    *aliases = NULL;
+/* Other tasks don't run while this one keeps its queue busy, so their
+ * sockets are polled on their behalf: one with events waiting counts as
+ * busy too. */
+static void disp_peek_others(struct dispatcher *disp)
+{
+    struct per_task *t;
+    int h, i;
+    u_int j;
 
-    freehostent(he);
-    GHBN_RET(ghbn, done_len);
+    for (h = 0; h < TASK_HASH; h++) {
+        for (t = tasks[h]; t; t = t->next) {
+            struct dispatcher *d = &t->disp;
+
+            if (d == disp || !d->sel || d->hot)
+                continue;
+            disp_poll(d);
+            for (i = 0; i < 3 && !d->hot; i++) {
+                for (j = 0; j < d->sel->armed[i].fd_count; j++) {
+                    if (socks.revents[d->sel->armed[i].fd_array[j]] &
+                            sel_ev[i]) {
+                        disp_set_hot(d, 1);
+                        break;
+                    }
+                }
+            }
+        }
+    }
 }
 
-static int AsyncGetHostByName(struct async_base *base)
+static void disp_run(struct dispatcher *disp)
 {
-    _AsyncGetHostByName(base);
-    base->handler = NULL;
-    return 1;
+    struct async_base *async;
+    int pending = 0, budget = 0;
+
+    disp_poll(disp);
+    if (!disp->depth) {
+        disp->yield = 0;
+        /* this one's share counts as hot whatever its last run was */
+        disp->budget = ev_budget ?
+                max(ev_budget / (hot_disps + !disp->hot), 1) : INT_MAX;
+        budget = disp->budget;
+    }
+    disp->depth++;
+    for (async = disp->head; async; async = async->next) {
+        if (async->done)
+            continue;
+        if (async->busy) {
+            pending++;
+            continue;
+        }
+        if (disp->budget <= 0 && async->aid == I_ASEL && !async->cancel) {
+            if (!disp->resume) {
+                disp->resume = async;
+                disp->st.deferred++;
+            }
+            pending++;
+            continue;
+        }
+        DEBUG_STR("\tASYNC event %i\n", async->aid);
+        async->busy++;
+        if (async->handler(async))
+            async->done++;
+        else
+            pending++;
+        async->busy--;
+    }
+    disp->depth--;
+    if (!disp->depth)
+        disp_set_hot(disp, disp->resume || disp->budget < budget);
+    if (disp->resume && !disp->depth) {
+        disp_rotate(disp);
+        disp_peek_others(disp);
+        /* let the other busy tasks run, or go on right away if none */
+        if (hot_disps > 1)
+            disp->yield++;
+        else
+            disp_kick(disp);
+    }
+    if (!disp->depth)
+        disp_reap(disp);
+    /* newly armed sockets are checked right away, not on next tick */
+    if (disp->sel->added) {
+        disp->sel->added = 0;
+        disp_kick(disp);
+    }
+
+    if (!pending) {
+        if (disp->timer) {
+            KillTimer(disp->hWnd, 1);
+            disp->timer = 0;
+            TRACE(TR_TIMER, 0, 0, 0);
+            debug_out("killing timer\n");
+        }
+        return;
+    }
+
+    /* back off exponentially while nothing happens */
+    if (disp->events || disp->yield) {
+        disp->events = 0;
+        disp->interval = poll_min;
+        disp->spin = poll_spin;
+    } else if (disp->spin) {
+        disp->spin--;
+    } else if (disp->interval < poll_max) {
+        disp->interval = min(disp->interval * 2, poll_max);
+    }
+    if (disp->spin)
+        disp_kick(disp);
+    if (disp->timer != disp->interval) {
+        disp->timer = disp->interval;
+        SetTimer(disp->hWnd, 1, disp->timer, NULL);
+        stats.timer_sets++;
+        TRACE(TR_TIMER, 0, disp->timer, 0);
+        DEBUG_STR("setting timer %u\n", disp->timer);
+    }
 }
 
-HANDLE pascal far WSAAsyncGetHostByName(HWND hWnd, u_int wMsg,
-					const char FAR *name,
-					char FAR *buf, int buflen)
+/* the task did something that may produce events soon */
+static void disp_activity(struct dispatcher *disp)
 {
-    struct per_task *task = task_find(GetCurrentTask());
-    HANDLE id = wsa_id;
-    struct per_async *async;
-    HWND wnd;
+    if (!disp->head)
+        return;
+    disp->interval = poll_min;
+    disp->spin = poll_spin;
+    disp_kick(disp);
+}
+
+/* callback needs to be exported so that Windows can patch its prolog
+ * with proper dataseg - same that it passes to LibMain() */
+LRESULT CALLBACK _export WSAWindowProc(HWND hWnd, UINT wMsg,
+        WPARAM wParam, LPARAM lParam)
+{
+    struct per_task *task = (struct per_task *)GetWindowLong(hWnd, 0);
 
     _ENT();
-    if (!name || buflen < MAXGETHOSTSTRUCT) {
-        _WSAE(task->wsa_err) = WSAEINVAL;
-        return 0;
+    switch (wMsg) {
+    case WM_USER:
+        task->disp.kicked = 0;
+        disp_run(&task->disp);
+        break;
+
+    case WM_TIMER:
+        DEBUG_STR("fired timer %i\n", wParam);
+        stats.timer_fires++;
+        disp_run(&task->disp);
+        break;
+
+    default:
+        DEBUG_STR("\twmsg 0x%x\n", wMsg);
+        return DefWindowProc(hWnd, wMsg, wParam, lParam);
     }
 
-    async = &asyncs[id];
-    assert(!async->base.handler);
-    memset(async, 0, sizeof(struct per_async));
-    async->base.aid = I_ASYNC;
-    async->base.handler = AsyncGetHostByName;
-    async->ghbn.id = id + 1;
-    async->ghbn.hWnd = hWnd;
-    async->ghbn.wMsg = wMsg;
-    async->ghbn.name = name;
-    async->ghbn.buf = buf;
-    async->ghbn.buflen = buflen;
+    if (task->dead && !task->disp.depth)
+        task_reap(task);
+    return 0;
+}
+
+/* The dispatcher window is created on first use and lives until
+ * WSACleanup(), so queueing a request costs no USER resources. */
+static int async_add(struct per_task *task, struct async_base *async)
+{
+    struct dispatcher *disp = &task->disp;
 
-    wnd = CreateWindow(WSAClassName, __FUNCTION__,
+    if (!disp->hWnd) {
+        disp->sel = calloc(1, sizeof(struct sel_engine));
+        if (!disp->sel)
+            return -1;
+        disp->hWnd = CreateWindow(WSAClassName, "OpenWinsock Dispatcher",
                         WS_OVERLAPPEDWINDOW,
                         CW_USEDEFAULT, CW_USEDEFAULT,
                         CW_USEDEFAULT, CW_USEDEFAULT,
-                        NULL, NULL,
+                        0, 0,
                         hinst,
                         NULL);
-    if (!wnd) {
-        async->base.handler = NULL;
-        _WSAE(task->wsa_err) = WSANO_RECOVERY;
+        if (!disp->hWnd) {
+            free(disp->sel);
+            disp->sel = NULL;
+            return -1;
+        }
+        SetWindowLong(disp->hWnd, 0, (long)task);
+        disp->interval = poll_min;
+    }
+    async->next = NULL;
+    async->disp = disp;
+    if (disp->tail)
+        disp->tail->next = async;
+    else
+        disp->head = async;
+    if (++stats.queue > stats.queue_hwm)
+        stats.queue_hwm = stats.queue;
+    disp->tail = async;
+    if (++disp->count > disp->st.queue_hwm)
+        disp->st.queue_hwm = disp->count;
+    /* busy until its next run has seen to the request */
+    disp_set_hot(disp, 1);
+    /* a new request on a backed-off dispatcher must not wait poll_max */
+    disp_activity(disp);
+    return 0;
+}
+
+/* TaskQueue: one task may not take all the records and slots */
+static int task_full(struct per_task *task)
+{
+    if (!task_queue || task->disp.count < task_queue)
         return 0;
+    task->disp.st.refused++;
+    _WSAE(task->wsa_err) = WSAENOBUFS;
+    return 1;
+}
+
+static void disp_destroy(struct dispatcher *disp)
+{
+    struct async_base *async;
+
+    if (!disp->hWnd)
+        return;
+    for (async = disp->head; async; async = async->next) {
+        if (!async->done)
+            async_cancel(async);
     }
-    PostMessage(wnd, WM_USER, 0, (long)async);
+    disp_run(disp);
+    /* requests still on the stack keep the window alive */
+    if (disp->head)
+        return;
+    disp_set_hot(disp, 0);
+    DestroyWindow(disp->hWnd);
+    free(disp->sel);
+    memset(disp, 0, sizeof(*disp));
+}
 
-    wsa_id++;
-    wsa_id &= MAX_ASYNC_M1;
-    _LVE();
-    return id + 1;
+BOOL FAR PASCAL LibMain(HINSTANCE hInstance, WORD wDataSegment,
+			WORD wHeapSize, LPSTR lpszCmdLine)
+{
+    WNDCLASS wc = {0};
+
+#ifdef DEBUG
+    idComm = OpenComm("COM4", 16384, 16384);
+#endif
+    _ENT();
+    DEBUG_STR("hInstance=%x dataseg=%x heapsize=%x cmdline=%s\n",
+            hInstance, wDataSegment, wHeapSize, lpszCmdLine);
+    d2s_set_blocking_hook(blk_func);
+#ifdef DEBUG
+    d2s_set_debug_hook(debug_out);
+#endif
+    d2s_set_close_hook(close_func);
+    hinst = hInstance;
+
+    /* 0 would be a zero-interval timer that never backs off */
+    poll_min = max(GetProfileInt(IniSection, "PollMin", poll_min), 1);
+    poll_max = max(GetProfileInt(IniSection, "PollMax", poll_max), poll_min);
+    poll_spin = GetProfileInt(IniSection, "PollSpin", poll_spin);
+    ev_budget = max(GetProfileInt(IniSection, "EventBudget", ev_budget), 0);
+    task_queue = max(GetProfileInt(IniSection, "TaskQueue", task_queue), 0);
+    blk_wait = GetProfileInt(IniSection, "BlockWait", blk_wait);
+    ra_size = min(max(GetProfileInt(IniSection, "ReadAhead", ra_size), 0),
+            RA_MAX);
+    wc_size = min(max(GetProfileInt(IniSection, "WriteCombine", wc_size), 0),
+            RA_MAX);
+    uq_size = min(max(GetProfileInt(IniSection, "UdpQueue", uq_size), 0),
+            RA_MAX);
+    max_udp_dg = min(GetProfileInt(IniSection, "MaxUdpDg", max_udp_dg),
+            32767U);
+    nr_ttl = GetProfileInt(IniSection, "FionreadTTL", nr_ttl);
+    dns_fwd.st.size = GetProfileInt(IniSection, "DnsCache", dns_fwd.st.size);
+    dns_rev.st.size = GetProfileInt(IniSection, "DnsRevCache",
+            dns_rev.st.size);
+    dns_ttl = GetProfileInt(IniSection, "DnsTTL", (int)dns_ttl);
+    dns_neg_ttl = GetProfileInt(IniSection, "DnsNegTTL", (int)dns_neg_ttl);
+    trace_init(GetProfileInt(IniSection, "Trace", 0));
+
+    wc.style = 0;
+    wc.lpfnWndProc = WSAWindowProc;
+    wc.cbWndExtra = sizeof(long);
+    wc.hInstance = hInstance;
+    wc.lpszClassName = WSAClassName;
+    RegisterClass(&wc);
+    return 1;
+}
+
+#pragma off (unreferenced);
+int FAR PASCAL WEP(int nParameter)
+#pragma on (unreferenced);
+{
+    _ENT();
+    d2s_set_blocking_hook(NULL);
+    d2s_set_debug_hook(NULL);
+    pool_done(&asel_pool);
+    async_slots_done();
+    dns_done();
+    dns_flush(&dns_fwd);
+    dns_flush(&dns_rev);
+    free(dns_fwd.ent);
+    free(dns_rev.ent);
+    dns_fwd.ent = dns_rev.ent = NULL;
+    netdb_unload();
+    sock_done();
+    trace_done();
+#ifdef DEBUG
+    if (idComm > 0)
+	CloseComm(idComm);
+#endif
+    return (1);
+}
+
+/*
+ * Services and protocols database. Compiled-in tables, optionally
+ * overlaid with the SERVICES and PROTOCOL files (WIN.INI [OpenWinsock]
+ * Services and Protocols, default: in the windows directory), loaded
+ * on the first WSAStartup(). Lookups are binary searches on indexes
+ * by name and by port/number, so they never go to the host.
+ */
+struct netdb_rec {
+    const char FAR *name;
+    const char FAR *proto;          /* NULL for protocols */
+    int num;                        /* port or protocol, host order */
+    const char FAR * FAR *aliases;  /* NULL-terminated or NULL */
+};
+
+static const char FAR *http_al[] = { "www", "www-http", NULL };
+static const char FAR *imap_al[] = { "imap2", NULL };
+static const char FAR *pop3_al[] = { "pop-3", NULL };
+static const char FAR *sunrpc_al[] = { "portmapper", NULL };
+static const char FAR *auth_al[] = { "ident", "tap", NULL };
+static const char FAR *printer_al[] = { "spooler", NULL };
+static const char FAR *shell_al[] = { "cmd", NULL };
+static const char FAR *domain_al[] = { "nameserver", "dns", NULL };
+static const char FAR *nntp_al[] = { "readnews", "untp", NULL };
+static const char FAR *smtp_al[] = { "mail", NULL };
+
+static const struct netdb_rec serv_builtin[] = {
+    { "auth",        "tcp", 113,  auth_al },
+    { "biff",        "udp", 512,  NULL },
+    { "bootpc",      "udp", 68,   NULL },
+    { "bootps",      "udp", 67,   NULL },
+    { "chargen",     "tcp", 19,   NULL },
+    { "chargen",     "udp", 19,   NULL },
+    { "daytime",     "tcp", 13,   NULL },
+    { "daytime",     "udp", 13,   NULL },
+    { "discard",     "tcp", 9,    NULL },
+    { "discard",     "udp", 9,    NULL },
+    { "domain",      "tcp", 53,   domain_al },
+    { "domain",      "udp", 53,   domain_al },
+    { "echo",        "tcp", 7,    NULL },
+    { "echo",        "udp", 7,    NULL },
+    { "exec",        "tcp", 512,  NULL },
+    { "finger",      "tcp", 79,   NULL },
+    { "ftp",         "tcp", 21,   NULL },
+    { "ftp-data",    "tcp", 20,   NULL },
+    { "gopher",      "tcp", 70,   NULL },
+    { "http",        "tcp", 80,   http_al },
+    { "https",       "tcp", 443,  NULL },
+    { "imap",        "tcp", 143,  imap_al },
+    { "imaps",       "tcp", 993,  NULL },
+    { "irc",         "tcp", 194,  NULL },
+    { "ircd",        "tcp", 6667, NULL },
+    { "kerberos",    "tcp", 88,   NULL },
+    { "kerberos",    "udp", 88,   NULL },
+    { "ldap",        "tcp", 389,  NULL },
+    { "login",       "tcp", 513,  NULL },
+    { "netbios-dgm", "udp", 138,  NULL },
+    { "netbios-ns",  "udp", 137,  NULL },
+    { "netbios-ssn", "tcp", 139,  NULL },
+    { "nntp",        "tcp", 119,  nntp_al },
+    { "ntalk",       "udp", 518,  NULL },
+    { "ntp",         "udp", 123,  NULL },
+    { "pop2",        "tcp", 109,  NULL },
+    { "pop3",        "tcp", 110,  pop3_al },
+    { "pop3s",       "tcp", 995,  NULL },
+    { "printer",     "tcp", 515,  printer_al },
+    { "qotd",        "tcp", 17,   NULL },
+    { "route",       "udp", 520,  NULL },
+    { "shell",       "tcp", 514,  shell_al },
+    { "smtp",        "tcp", 25,   smtp_al },
+    { "snmp",        "udp", 161,  NULL },
+    { "snmp-trap",   "udp", 162,  NULL },
+    { "socks",       "tcp", 1080, NULL },
+    { "ssh",         "tcp", 22,   NULL },
+    { "sunrpc",      "tcp", 111,  sunrpc_al },
+    { "sunrpc",      "udp", 111,  sunrpc_al },
+    { "syslog",      "udp", 514,  NULL },
+    { "systat",      "tcp", 11,   NULL },
+    { "talk",        "udp", 517,  NULL },
+    { "telnet",      "tcp", 23,   NULL },
+    { "tftp",        "udp", 69,   NULL },
+    { "time",        "tcp", 37,   NULL },
+    { "time",        "udp", 37,   NULL },
+    { "uucp",        "tcp", 540,  NULL },
+    { "who",         "udp", 513,  NULL },
+    { "whois",       "tcp", 43,   NULL },
+};
+
+static const struct netdb_rec proto_builtin[] = {
+    { "egp",         NULL,  8,    NULL },
+    { "ggp",         NULL,  3,    NULL },
+    { "icmp",        NULL,  1,    NULL },
+    { "idp",         NULL,  22,   NULL },
+    { "igmp",        NULL,  2,    NULL },
+    { "ip",          NULL,  0,    NULL },
+    { "pup",         NULL,  12,   NULL },
+    { "raw",         NULL,  255,  NULL },
+    { "tcp",         NULL,  6,    NULL },
+    { "udp",         NULL,  17,   NULL },
+};
+
+#define COUNTOF(a) (sizeof(a) / sizeof((a)[0]))
+
+/* a name index entry points at the record it names, aliases included */
+struct netdb_key {
+    const char FAR *name;
+    const struct netdb_rec FAR *rec;
+};
+
+struct netdb {
+    const struct netdb_rec FAR *recs;
+    int count;
+    struct netdb_key FAR *by_name;
+    int names;
+    const struct netdb_rec FAR * FAR *by_num;
+    struct netdb_rec FAR *file_recs;    /* records from the file first */
+    int nfile;
+    char FAR *text;                 /* file contents the records point to */
+};
+static struct netdb serv_db;
+static struct netdb proto_db;
+static int netdb_loaded;
+
+static int nocase_cmp(const char FAR *a, const char FAR *b)
+{
+    int d;
+
+    for (; *a || *b; a++, b++) {
+        d = tolower(*a) - tolower(*b);
+        if (d)
+            return d;
+    }
+    return 0;
+}
+
+static int proto_cmp(const char FAR *a, const char FAR *b)
+{
+    if (!a || !b)
+        return 0;
+    return nocase_cmp(a, b);
+}
+
+/* ties are broken by position, so file entries win over builtin ones */
+static int name_key_cmp(const void *a, const void *b)
+{
+    const struct netdb_key FAR *ka = a;
+    const struct netdb_key FAR *kb = b;
+    int d = nocase_cmp(ka->name, kb->name);
+
+    if (!d)
+        d = proto_cmp(ka->rec->proto, kb->rec->proto);
+    if (!d)
+        d = (ka->rec > kb->rec) - (ka->rec < kb->rec);
+    return d;
+}
+
+static int num_key_cmp(const void *a, const void *b)
+{
+    const struct netdb_rec FAR *ra = *(const struct netdb_rec FAR * FAR *)a;
+    const struct netdb_rec FAR *rb = *(const struct netdb_rec FAR * FAR *)b;
+    int d = (ra->num > rb->num) - (ra->num < rb->num);
+
+    if (!d)
+        d = proto_cmp(ra->proto, rb->proto);
+    if (!d)
+        d = (ra > rb) - (ra < rb);
+    return d;
+}
+
+static int netdb_index(struct netdb *db)
+{
+    const char FAR * FAR *al;
+    int i, n = 0;
+
+    for (i = 0; i < db->count; i++) {
+        n++;
+        for (al = db->recs[i].aliases; al && *al; al++)
+            n++;
+    }
+    db->by_name = malloc(n * sizeof(struct netdb_key));
+    db->by_num = malloc(db->count * sizeof(db->by_num[0]));
+    if (!db->by_name || !db->by_num)
+        return -1;
+    db->names = 0;
+    for (i = 0; i < db->count; i++) {
+        const struct netdb_rec FAR *rec = &db->recs[i];
+
+        db->by_name[db->names].name = rec->name;
+        db->by_name[db->names++].rec = rec;
+        for (al = rec->aliases; al && *al; al++) {
+            db->by_name[db->names].name = *al;
+            db->by_name[db->names++].rec = rec;
+        }
+        db->by_num[i] = rec;
+    }
+    qsort(db->by_name, db->names, sizeof(struct netdb_key), name_key_cmp);
+    qsort(db->by_num, db->count, sizeof(db->by_num[0]), num_key_cmp);
+    return 0;
+}
+
+/* first matching record; a NULL proto matches any */
+static const struct netdb_rec FAR *netdb_by_name(struct netdb *db,
+                                                 const char FAR *name,
+                                                 const char FAR *proto)
+{
+    int lo = 0, hi = db->names;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        const struct netdb_key FAR *k = &db->by_name[mid];
+        int d = nocase_cmp(k->name, name);
+
+        if (!d && proto)
+            d = nocase_cmp(k->rec->proto, proto);
+        if (d < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < db->names && !nocase_cmp(db->by_name[lo].name, name) &&
+            (!proto || !nocase_cmp(db->by_name[lo].rec->proto, proto)))
+        return db->by_name[lo].rec;
+    return NULL;
+}
+
+static const struct netdb_rec FAR *netdb_by_num(struct netdb *db, int num,
+                                                const char FAR *proto)
+{
+    int lo = 0, hi = db->count;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        const struct netdb_rec FAR *r = db->by_num[mid];
+        int d = (r->num > num) - (r->num < num);
+
+        if (!d && proto)
+            d = nocase_cmp(r->proto, proto);
+        if (d < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < db->count && db->by_num[lo]->num == num &&
+            (!proto || !nocase_cmp(db->by_num[lo]->proto, proto)))
+        return db->by_num[lo];
+    return NULL;
+}
+
+#define NETDB_MAX_TEXT 32000
+#define NETDB_MAX_ALIASES 8
+
+static char FAR *netdb_read(const char *key, const char *file)
+{
+    char path[128];
+    char FAR *text;
+    HFILE f;
+    UINT len;
+
+    len = GetWindowsDirectory(path, sizeof(path) - 16);
+    if (len && path[len - 1] != '\\')
+        path[len++] = '\\';
+    strcpy(path + len, file);
+    GetProfileString(IniSection, key, path, path, sizeof(path));
+    f = _lopen(path, OF_READ);
+    if (f == HFILE_ERROR)
+        return NULL;
+    /* one byte over tells a file that doesn't fit */
+    text = malloc(NETDB_MAX_TEXT + 2);
+    if (text) {
+        len = _lread(f, text, NETDB_MAX_TEXT + 1);
+        if (len == (UINT)HFILE_ERROR || len > NETDB_MAX_TEXT) {
+            DEBUG_STR("%s unreadable or too large, ignored\n", path);
+            free(text);
+            text = NULL;
+        } else {
+            text[len] = '\0';
+        }
+    }
+    _lclose(f);
+    if (text)
+        DEBUG_STR("loaded %s\n", path);
+    return text;
+}
+
+static char FAR *next_tok(char FAR **p)
+{
+    char FAR *s = *p;
+    char FAR *ret;
+
+    while (*s == ' ' || *s == '\t')
+        s++;
+    if (!*s) {
+        *p = s;
+        return NULL;
+    }
+    ret = s;
+    while (*s && *s != ' ' && *s != '\t')
+        s++;
+    if (*s)
+        *s++ = '\0';
+    *p = s;
+    return ret;
+}
+
+/* "name port/proto aliases..." or "name number aliases..." lines */
+static int netdb_parse(char FAR *text, int services, struct netdb_rec FAR *recs,
+                       int max)
+{
+    char FAR *line = text;
+    int n = 0;
+
+    while (*line && n < max) {
+        char FAR *end = line;
+        char FAR *p, FAR *name, FAR *num, FAR *tok, FAR *slash;
+        const char FAR * FAR *al;
+        int i;
+
+        while (*end && *end != '\n')
+            end++;
+        if (*end)
+            *end++ = '\0';
+        for (p = line; *p; p++) {
+            if (*p == '#' || *p == '\r') {
+                *p = '\0';
+                break;
+            }
+        }
+        p = line;
+        line = end;
+        name = next_tok(&p);
+        num = next_tok(&p);
+        if (!name || !num)
+            continue;
+        slash = strchr(num, '/');
+        if (services != !!slash)
+            continue;
+        if (slash)
+            *slash++ = '\0';
+        recs[n].name = name;
+        recs[n].num = atoi(num);
+        recs[n].proto = slash;
+        recs[n].aliases = NULL;
+        al = malloc((NETDB_MAX_ALIASES + 1) * sizeof(*al));
+        if (al) {
+            for (i = 0; i < NETDB_MAX_ALIASES && (tok = next_tok(&p)); i++)
+                al[i] = tok;
+            al[i] = NULL;
+            recs[n].aliases = al;
+        }
+        n++;
+    }
+    return n;
+}
+
+static void netdb_load(struct netdb *db, const char *key, const char *file,
+                       int services, const struct netdb_rec *builtin,
+                       int nbuiltin)
+{
+    struct netdb_rec FAR *recs;
+    char FAR *text = netdb_read(key, file);
+    char FAR *p;
+    int lines = 1;
+
+    db->recs = builtin;
+    db->count = nbuiltin;
+    if (text) {
+        for (p = text; *p; p++)
+            lines += (*p == '\n');
+        /* size_t is 16 bits, a file of short lines would wrap it */
+        recs = NULL;
+        if (lines <= UINT_MAX / sizeof(struct netdb_rec) - nbuiltin)
+            recs = malloc((lines + nbuiltin) * sizeof(struct netdb_rec));
+        if (recs) {
+            int n = netdb_parse(text, services, recs, lines);
+
+            memcpy(&recs[n], builtin, nbuiltin * sizeof(struct netdb_rec));
+            db->recs = recs;
+            db->count = n + nbuiltin;
+            db->file_recs = recs;
+            db->nfile = n;
+            db->text = text;
+        } else {
+            free(text);
+        }
+    }
+    if (netdb_index(db)) {
+        free(db->by_name);
+        free(db->by_num);
+        db->by_name = NULL;
+        db->by_num = NULL;
+        db->names = db->count = 0;
+    }
+}
+
+static void netdb_init(void)
+{
+    if (netdb_loaded)
+        return;
+    netdb_loaded++;
+    netdb_load(&serv_db, "Services", "SERVICES", 1,
+            serv_builtin, COUNTOF(serv_builtin));
+    netdb_load(&proto_db, "Protocols", "PROTOCOL", 0,
+            proto_builtin, COUNTOF(proto_builtin));
+}
+
+static void netdb_done(struct netdb *db)
+{
+    int i;
+
+    for (i = 0; i < db->nfile; i++)
+        free((void FAR *)db->file_recs[i].aliases);
+    free(db->file_recs);
+    free(db->text);
+    free(db->by_name);
+    free((void FAR *)db->by_num);
+    memset(db, 0, sizeof(*db));
+}
+
+static void netdb_unload(void)
+{
+    netdb_done(&serv_db);
+    netdb_done(&proto_db);
+    netdb_loaded = 0;
+}
+
+/* Lay out a servent or protoent, returns the size needed. Nothing is
+ * written if that's more than buflen. */
+static int pack_netdb(char FAR *buf, int buflen,
+                      const struct netdb_rec FAR *rec)
+{
+    int ent_len = rec->proto ? sizeof(struct servent) :
+            sizeof(struct protoent);
+    const char FAR * FAR *al;
+    char FAR * FAR *dal;
+    char FAR *data;
+    int len, nal = 0;
+
+    len = ent_len + strlen(rec->name) + 1;
+    for (al = rec->aliases; al && *al; al++, nal++)
+        len += strlen(*al) + 1;
+    len += (nal + 1) * sizeof(char FAR *);
+    if (rec->proto)
+        len += strlen(rec->proto) + 1;
+    if (len > buflen)
+        return len;
+
+    dal = (char FAR * FAR *)(buf + ent_len);
+    data = (char FAR *)(dal + nal + 1);
+    if (rec->proto) {
+        struct servent FAR *se = (struct servent FAR *)buf;
+
+        se->s_aliases = dal;
+        se->s_port = htons(rec->num);
+        se->s_proto = data;
+        strcpy(data, rec->proto);
+        data += strlen(data) + 1;
+        se->s_name = data;
+    } else {
+        struct protoent FAR *pe = (struct protoent FAR *)buf;
+
+        pe->p_aliases = dal;
+        pe->p_proto = rec->num;
+        pe->p_name = data;
+    }
+    strcpy(data, rec->name);
+    data += strlen(data) + 1;
+    for (al = rec->aliases; al && *al; al++) {
+        *dal++ = data;
+        strcpy(data, *al);
+        data += strlen(data) + 1;
+    }
+    *dal = NULL;
+    return len;
+}
+
+/* A handle for a request that is answered right away. It has no slot,
+ * so a burst of cache hits doesn't run through the generations of one
+ * and make a stale handle match a live request. */
+static HANDLE async_id(void)
+{
+    async_imm = async_imm % ASYNC_GEN_M1 + 1;
+    return ASYNC_HANDLE(-1, async_imm);
+}
+
+static HANDLE async_netdb(struct per_task *task, HWND hWnd, u_int wMsg,
+                          const struct netdb_rec FAR *rec,
+                          char FAR *buf, int buflen)
+{
+    HANDLE id;
+    int len;
+
+    if (!buf) {
+        _WSAE(task->wsa_err) = WSAEFAULT;
+        return 0;
+    }
+    id = async_id();
+    stats.posts++;
+    if (!rec) {
+        PostMessage(hWnd, wMsg, id, WSAMAKEASYNCREPLY(0, WSANO_DATA));
+        return id;
+    }
+    len = pack_netdb(buf, buflen, rec);
+    PostMessage(hWnd, wMsg, id,
+            WSAMAKEASYNCREPLY(len, len > buflen ? WSAENOBUFS : 0));
+    return id;
+}
+
+HANDLE pascal far WSAAsyncGetServByName(HWND hWnd, u_int wMsg,
+					const char FAR *name,
+					const char FAR *proto,
+					char FAR *buf, int buflen)
+{
+    struct per_task *task = task_find(GetCurrentTask());
+
+    _ENT();
+    assert(task);
+    stat_call(OWS_API_ASYNCGETSERVBYNAME);
+    if (!name) {
+        _WSAE(task->wsa_err) = WSAEINVAL;
+        return 0;
+    }
+    return async_netdb(task, hWnd, wMsg,
+            netdb_by_name(&serv_db, name, proto), buf, buflen);
+}
+
+HANDLE pascal far WSAAsyncGetServByPort(HWND hWnd, u_int wMsg, int port,
+					const char FAR *proto,
+					char FAR *buf, int buflen)
+{
+    struct per_task *task = task_find(GetCurrentTask());
+
+    _ENT();
+    assert(task);
+    stat_call(OWS_API_ASYNCGETSERVBYPORT);
+    return async_netdb(task, hWnd, wMsg,
+            netdb_by_num(&serv_db, ntohs(port), proto), buf, buflen);
+}
+
+HANDLE pascal far WSAAsyncGetProtoByName(HWND hWnd, u_int wMsg,
+					 const char FAR *name,
+					 char FAR *buf, int buflen)
+{
+    struct per_task *task = task_find(GetCurrentTask());
+
+    _ENT();
+    assert(task);
+    stat_call(OWS_API_ASYNCGETPROTOBYNAME);
+    if (!name) {
+        _WSAE(task->wsa_err) = WSAEINVAL;
+        return 0;
+    }
+    return async_netdb(task, hWnd, wMsg,
+            netdb_by_name(&proto_db, name, NULL), buf, buflen);
+}
+
+HANDLE pascal far WSAAsyncGetProtoByNumber(HWND hWnd, u_int wMsg,
+					   int number, char FAR *buf,
+					   int buflen)
+{
+    struct per_task *task = task_find(GetCurrentTask());
+
+    _ENT();
+    assert(task);
+    stat_call(OWS_API_ASYNCGETPROTOBYNUMBER);
+    return async_netdb(task, hWnd, wMsg,
+            netdb_by_num(&proto_db, number, NULL), buf, buflen);
+}
+
+#define GHBN_RET(g, l) { \
+        int _l = (l); \
+        LPARAM _lp = WSAMAKEASYNCREPLY(_l, _l > g->buflen ? WSAENOBUFS : 0); \
+        TRACE(TR_POST, g->hWnd, g->wMsg, _lp); \
+        stats.posts++; \
+        PostMessage(g->hWnd, g->wMsg, g->id, _lp); \
+}
+#define GHBN_ERR(g, e) { \
+        TRACE(TR_POST, g->hWnd, g->wMsg, WSAMAKEASYNCREPLY(0, e)); \
+        stats.posts++; \
+        PostMessage(g->hWnd, g->wMsg, g->id, WSAMAKEASYNCREPLY(0, e)); \
+}
+
+/* Lay out a hostent compactly: pointer arrays first, then the
+ * addresses, then the strings. Everything but the address list must
+ * fit, addresses are added while there is room. Returns the size
+ * written, or the size needed for the whole entry if not even one
+ * address fits (nothing is written then). */
+static int pack_hostent(char FAR *buf, int buflen,
+                        const struct hostent FAR *he)
+{
+    struct hostent FAR *dst = (struct hostent FAR *)buf;
+    char FAR **ptr;
+    char FAR *data;
+    int nal, nad, fit, core, len, i;
+
+    len = strlen(he->h_name) + 1;
+    for (nal = 0; he->h_aliases[nal]; nal++)
+        len += strlen(he->h_aliases[nal]) + 1;
+    for (nad = 0; he->h_addr_list[nad]; nad++);
+    len += sizeof(struct hostent) + sizeof(char FAR *) * (nal + 2);
+    core = len;
+    if (nad)
+        core += sizeof(char FAR *) + he->h_length;
+    if (core > buflen)
+        return len + nad * (sizeof(char FAR *) + he->h_length);
+    fit = (buflen - len) / (sizeof(char FAR *) + he->h_length);
+    if (fit < nad)
+        nad = fit;
+
+    *dst = *he;
+    ptr = (char FAR **)(dst + 1);
+    dst->h_aliases = ptr;
+    dst->h_addr_list = ptr + nal + 1;
+    data = (char FAR *)(ptr + nal + nad + 2);
+    for (i = 0; i < nad; i++) {
+        memcpy(data, he->h_addr_list[i], he->h_length);
+        dst->h_addr_list[i] = data;
+        data += he->h_length;
+    }
+    dst->h_addr_list[nad] = NULL;
+    dst->h_name = data;
+    strcpy(data, he->h_name);
+    data += strlen(data) + 1;
+    for (i = 0; i < nal; i++) {
+        dst->h_aliases[i] = data;
+        strcpy(data, he->h_aliases[i]);
+        data += strlen(data) + 1;
+    }
+    dst->h_aliases[nal] = NULL;
+    return data - buf;
+}
+
+static void dns_fold(char *dst, const char FAR *name, int len)
+{
+    int i;
+
+    for (i = 0; i < len - 1 && name[i]; i++)
+        dst[i] = tolower(name[i]);
+    dst[i] = '\0';
+}
+
+/* returns 0 if the address is not cacheable */
+static int dns_addr_key(char *dst, const char FAR *addr, int len, int type)
+{
+    const u_char FAR *a = (const u_char FAR *)addr;
+
+    if (type != AF_INET || len != 4)
+        return 0;
+    sprintf(dst, "%u.%u.%u.%u", a[0], a[1], a[2], a[3]);
+    return 1;
+}
+
+static void dns_drop(struct dns_cache *cache, struct dns_entry *ent)
+{
+    free(ent->name);
+    free(ent->he);
+    memset(ent, 0, sizeof(*ent));
+    cache->st.entries--;
+}
+
+static struct dns_entry *dns_lookup(struct dns_cache *cache, const char *key)
+{
+    int i;
+
+    for (i = 0; cache->ent && i < cache->st.size; i++) {
+        struct dns_entry *ent = &cache->ent[i];
+
+        if (!ent->name || strcmp(ent->name, key))
+            continue;
+        if (GetTickCount() - ent->stamp >= ent->ttl) {
+            dns_drop(cache, ent);
+            break;
+        }
+        ent->used = ++dns_clock;
+        cache->st.hits++;
+        return ent;
+    }
+    cache->st.misses++;
+    return NULL;
+}
+
+static void dns_insert(struct dns_cache *cache, const char *key,
+                       const struct hostent FAR *he, int err)
+{
+    struct dns_entry *ent = NULL;
+    int i;
+
+    if (!cache->st.size)
+        return;
+    if (!cache->ent) {
+        cache->ent = calloc(cache->st.size, sizeof(struct dns_entry));
+        if (!cache->ent)
+            return;
+    }
+    /* a free slot, otherwise the least recently used one */
+    for (i = 0; i < cache->st.size; i++) {
+        if (!cache->ent[i].name) {
+            ent = &cache->ent[i];
+            break;
+        }
+        if (!ent || cache->ent[i].used < ent->used)
+            ent = &cache->ent[i];
+    }
+    if (ent->name)
+        dns_drop(cache, ent);
+
+    ent->name = malloc(strlen(key) + 1);
+    if (!ent->name)
+        return;
+    strcpy(ent->name, key);
+    if (he) {
+        /* measure, then keep the entry at its exact size */
+        int len = pack_hostent(NULL, 0, he);
+
+        ent->he = malloc(len);
+        if (!ent->he) {
+            free(ent->name);
+            ent->name = NULL;
+            return;
+        }
+        pack_hostent((char FAR *)ent->he, len, he);
+    }
+    ent->err = err;
+    ent->stamp = GetTickCount();
+    ent->ttl = (he ? dns_ttl : dns_neg_ttl) * 1000;
+    ent->used = ++dns_clock;
+    cache->st.entries++;
+}
+
+static void dns_flush(struct dns_cache *cache)
+{
+    int i;
+
+    if (!cache->ent)
+        return;
+    for (i = 0; i < cache->st.size; i++) {
+        if (cache->ent[i].name)
+            dns_drop(cache, &cache->ent[i]);
+    }
+}
+
+/*
+ * Resolver engine. gethostbyname_ex() waits for its answer in the
+ * blocking hook, which dispatches the next lookup from there: lookups
+ * nest on the stack and finish last first. With WIN.INI DnsServer set,
+ * a lookup is a query on one non-blocking UDP socket instead, and the
+ * dispatcher polls that socket like an async select registration.
+ * Replies are matched to requests by ID, a random one for each query
+ * sent, retries too, and answered as they are read. Only addresses of
+ * the question name, or of the end of its CNAME chain, are taken.
+ * Unanswered queries go out again after DnsTimeout ms, doubling each
+ * time, DnsRetries times. Numeric names, names that don't fit a query
+ * and a resolver socket that can't be had fall back to libd2sock.
+ */
+#define DNS_PORT 53
+#define DNS_HDR 12
+#define DNS_ADDRS 16
+
+static struct sockaddr_in dns_srv;      /* sin_port 0: engine off */
+static SOCKET dns_sock = INVALID_SOCKET;
+static UINT dns_timeout = 1000;
+static int dns_retries = 3;
+static DWORD dns_seed;
+static BYTE dns_buf[512];
+/* question, canonical name, owner of a record */
+static char dns_qn[256], dns_cn[256], dns_on[256];
+
+static void dns_init(void)
+{
+    char buf[64], *port;
+    u_long addr;
+
+    dns_done();
+    dns_timeout = max(GetProfileInt(IniSection, "DnsTimeout", 1000), 1);
+    dns_retries = GetProfileInt(IniSection, "DnsRetries", 3);
+    GetProfileString(IniSection, "DnsServer", "", buf, sizeof(buf));
+    port = strchr(buf, ':');
+    if (port)
+        *port++ = '\0';
+    addr = inet_addr(buf);
+    if (!buf[0] || addr == INADDR_NONE)
+        return;
+    dns_srv.sin_family = AF_INET;
+    dns_srv.sin_addr.s_addr = addr;
+    dns_srv.sin_port = htons(port ? atoi(port) : DNS_PORT);
+    dns_seed ^= GetTickCount();
+}
+
+static void dns_done(void)
+{
+    if (dns_sock != INVALID_SOCKET)
+        closesocket(dns_sock);
+    dns_sock = INVALID_SOCKET;
+    memset(&dns_srv, 0, sizeof(dns_srv));
+}
+
+/* name in wire format, 0 if it can't be one */
+static int dns_qname(BYTE *q, const char FAR *name)
+{
+    BYTE *label = q;
+    int n = 1;
+
+    *label = 0;
+    for (; *name; name++) {
+        if (*name == '.') {
+            if (!*label)
+                return 0;
+            label = q + n++;
+            *label = 0;
+        } else {
+            if (*label == 63 || n == 254)
+                return 0;
+            q[n++] = *name;
+            (*label)++;
+        }
+    }
+    if (*label)
+        q[n++] = 0;
+    return n > 1 ? n : 0;
+}
+
+/* lookup whose query out has this ID */
+static struct per_async *dns_find(WORD id)
+{
+    int i;
+
+    for (i = 0; i < async_cnt; i++) {
+        struct per_async *arg = async_tab[i].async;
+
+        if (async_tab[i].used && arg && arg->ghbn.tries &&
+                !arg->ghbn.answered && !arg->base.cancel &&
+                arg->ghbn.qid == id)
+            return arg;
+    }
+    return NULL;
+}
+
+/* An ID no other query out has, nor the one it replaces. The tick
+ * count is stirred in on every draw: there is no better entropy. */
+static WORD dns_new_id(void)
+{
+    WORD id;
+
+    do {
+        dns_seed = dns_seed * 1103515245UL + 12345 + GetTickCount();
+        id = (WORD)(dns_seed >> 16);
+    } while (dns_find(id));
+    return id;
+}
+
+static int dns_send(struct per_async *arg)
+{
+    struct GHBN *ghbn = &arg->ghbn;
+    BYTE *p = dns_buf;
+    int n = dns_qname(p + DNS_HDR, ghbn->name);
+
+    if (!n)
+        return 0;
+    ghbn->qid = dns_new_id();
+    memset(p, 0, DNS_HDR);
+    p[0] = ghbn->qid >> 8;
+    p[1] = (BYTE)ghbn->qid;
+    p[2] = 1;                   /* recursion desired */
+    p[5] = 1;                   /* one question */
+    p += DNS_HDR + n;
+    *p++ = 0;
+    *p++ = 1;                   /* type A */
+    *p++ = 0;
+    *p++ = 1;                   /* class IN */
+    /* a lost send is like a lost reply: the timeout sends again */
+    sendto(dns_sock, (char *)dns_buf, p - dns_buf, 0,
+            (struct sockaddr *)&dns_srv, sizeof(dns_srv));
+    stats.dns_queries++;
+    ghbn->tries++;
+    ghbn->sent = GetTickCount();
+    return 1;
+}
+
+/* Read a name at off into out, lowercase and dotted, if out is given.
+ * Returns the offset past the name, 0 if it is malformed. */
+static int dns_name(const BYTE *msg, int len, int off, char *out)
+{
+    int end = 0, hops = 0, n = 0;
+
+    while (off < len) {
+        BYTE c = msg[off];
+
+        if ((c & 0xc0) == 0xc0) {
+            if (off + 1 >= len || ++hops > 16)
+                return 0;
+            if (!end)
+                end = off + 2;
+            off = ((c & 0x3f) << 8) | msg[off + 1];
+            continue;
+        }
+        if (c & 0xc0)
+            return 0;
+        off++;
+        if (!c) {
+            if (out)
+                out[n ? n - 1 : 0] = '\0';
+            return end ? end : off;
+        }
+        if (off + c > len || n + c + 1 > 255)
+            return 0;
+        if (out) {
+            int i;
+
+            for (i = 0; i < c; i++)
+                out[n + i] = tolower(msg[off + i]);
+            out[n + c] = '.';
+        }
+        n += c + 1;
+        off += c;
+    }
+    return 0;
+}
+
+/* Answer record at off, IN class only: its owner goes to dns_on, the
+ * offset of its data to *rd. Returns the offset past it, 0 if it is
+ * malformed or of another class. */
+static int dns_rr(const BYTE *msg, int len, int off, int *type, int *rd)
+{
+    int rdlen;
+
+    off = dns_name(msg, len, off, dns_on);
+    if (!off || off + 10 > len || msg[off + 2] || msg[off + 3] != 1)
+        return 0;
+    *type = (msg[off] << 8) | msg[off + 1];
+    rdlen = (msg[off + 8] << 8) | msg[off + 9];
+    off += 10;
+    if (off + rdlen > len)
+        return 0;
+    *rd = off;
+    return off + rdlen;
+}
+
+/* folded name against the app's, which may end with a dot */
+static int dns_same(const char *folded, const char FAR *name)
+{
+    while (*folded && tolower(*name) == *folded) {
+        folded++;
+        name++;
+    }
+    return !*folded && (!*name || (name[0] == '.' && !name[1]));
+}
+
+static void dns_answer(struct per_async *arg, const struct hostent FAR *he,
+                       int err)
+{
+    struct GHBN *ghbn = &arg->ghbn;
+    char key[256];
+
+    stat_time(OWS_API_RESOLVE, ghbn->start);
+    /* a server that fails or doesn't answer says nothing about the name */
+    if (he || err == WSAHOST_NOT_FOUND || err == WSANO_DATA) {
+        dns_fold(key, ghbn->name, sizeof(key));
+        dns_insert(&dns_fwd, key, he, err);
+    }
+    if (he) {
+        GHBN_RET(ghbn, pack_hostent(ghbn->buf, ghbn->buflen, he));
+    } else {
+        GHBN_ERR(ghbn, err);
+    }
+    ghbn->answered = 1;
+    arg->base.disp->events++;
+    /* the request may be another task's */
+    disp_kick(arg->base.disp);
+}
+
+static void dns_reply(const BYTE *msg, int len)
+{
+    char FAR *addrs[DNS_ADDRS + 1];
+    char FAR *aliases[2] = { dns_qn, NULL };
+    BYTE addr[DNS_ADDRS][4];
+    struct hostent he;
+    struct per_async *arg;
+    int i, an, ans, off, type, rd, hops, naddr = 0;
+
+    if (len < DNS_HDR || !(msg[2] & 0x80) || msg[4] || msg[5] != 1)
+        return;
+    arg = dns_find((msg[0] << 8) | msg[1]);
+    if (!arg)
+        return;
+    off = dns_name(msg, len, DNS_HDR, dns_qn);
+    if (!off || off + 4 > len || !dns_same(dns_qn, arg->ghbn.name))
+        return;
+    ans = off + 4;
+    strcpy(dns_cn, dns_qn);
+    an = (msg[6] << 8) | msg[7];
+    /* follow the CNAME chain, whatever order its records come in */
+    for (hops = 0; hops < 8; hops++) {
+        for (i = 0, off = ans; i < an; i++) {
+            off = dns_rr(msg, len, off, &type, &rd);
+            if (!off || (type == 5 && !strcmp(dns_on, dns_cn)))
+                break;
+        }
+        if (i == an || !off || !dns_name(msg, len, rd, dns_on))
+            break;
+        strcpy(dns_cn, dns_on);
+    }
+    /* the addresses of where it ends, no other name's */
+    for (i = 0, off = ans; i < an && naddr < DNS_ADDRS; i++) {
+        int next = dns_rr(msg, len, off, &type, &rd);
+
+        if (!next)
+            break;
+        if (type == 1 && next - rd == 4 && !strcmp(dns_on, dns_cn)) {
+            memcpy(addr[naddr], msg + rd, 4);
+            addrs[naddr] = (char FAR *)addr[naddr];
+            naddr++;
+        }
+        off = next;
+    }
+    if (!naddr) {
+        switch (msg[3] & 0x0f) {
+        case 0:
+            /* the name is there, with no address */
+            dns_answer(arg, NULL, WSANO_DATA);
+            break;
+        case 3:
+            dns_answer(arg, NULL, WSAHOST_NOT_FOUND);
+            break;
+        case 2:
+            /* SERVFAIL */
+            dns_answer(arg, NULL, WSATRY_AGAIN);
+            break;
+        default:
+            /* FORMERR, NOTIMP, REFUSED */
+            dns_answer(arg, NULL, WSANO_RECOVERY);
+            break;
+        }
+        return;
+    }
+    addrs[naddr] = NULL;
+    he.h_name = dns_cn;
+    he.h_aliases = strcmp(dns_cn, dns_qn) ? aliases : aliases + 1;
+    he.h_addrtype = AF_INET;
+    he.h_length = 4;
+    he.h_addr_list = addrs;
+    dns_answer(arg, &he, 0);
+}
+
+/* all replies there are, for whichever task they are */
+static void dns_recv(void)
+{
+    struct sockaddr_in from;
+    int n, fromlen;
+
+    if (!(socks.revents[dns_sock] & FD_READ))
+        return;
+    socks.revents[dns_sock] &= ~FD_READ;
+    for (;;) {
+        fromlen = sizeof(from);
+        n = recvfrom(dns_sock, (char *)dns_buf, sizeof(dns_buf), 0,
+                (struct sockaddr *)&from, &fromlen);
+        if (n <= 0)
+            break;
+        if (from.sin_addr.s_addr == dns_srv.sin_addr.s_addr &&
+                from.sin_port == dns_srv.sin_port)
+            dns_reply(dns_buf, n);
+    }
+}
+
+/* query for a new lookup, 0 to leave it to libd2sock */
+static int dns_start(struct per_async *arg)
+{
+    struct dispatcher *disp = arg->base.disp;
+    u_long on = 1;
+
+    if (!dns_srv.sin_port || inet_addr(arg->ghbn.name) != INADDR_NONE)
+        return 0;
+    if (dns_sock == INVALID_SOCKET) {
+        dns_sock = socket(AF_INET, SOCK_DGRAM, 0);
+        if (dns_sock == INVALID_SOCKET)
+            return 0;
+        if (!SOCK_OK(dns_sock) || ioctlsocket(dns_sock, FIONBIO, &on)) {
+            closesocket(dns_sock);
+            dns_sock = INVALID_SOCKET;
+            return 0;
+        }
+    }
+    arg->ghbn.start = GetTickCount();
+    arg->ghbn.wait = dns_timeout;
+    if (!dns_send(arg))
+        return 0;
+    if (!disp->dns_wait++) {
+        sset_add(&disp->sel->armed[0], dns_sock);
+        disp->sel->added++;
+    }
+    return 1;
+}
+
+/* a lookup's turn in the dispatcher, 1 when it is over */
+static int dns_step(struct per_async *arg)
+{
+    struct GHBN *ghbn = &arg->ghbn;
+    struct dispatcher *disp = arg->base.disp;
+
+    if (!ghbn->answered && !arg->base.cancel)
+        dns_recv();
+    if (!ghbn->answered && !arg->base.cancel) {
+        if (GetTickCount() - ghbn->sent < ghbn->wait)
+            return 0;
+        if (ghbn->tries <= dns_retries) {
+            ghbn->wait *= 2;
+            stats.dns_retries++;
+            dns_send(arg);
+            /* its reply is due soon, like a new request's */
+            disp_activity(disp);
+            return 0;
+        }
+        dns_answer(arg, NULL, WSATRY_AGAIN);
+    }
+    if (!--disp->dns_wait)
+        sset_del(&disp->sel->armed[0], dns_sock);
+    return 1;
+}
+
+static void _AsyncGetHostByName(struct async_base *base)
+{
+    struct per_async *arg = (struct per_async *)base;
+    struct GHBN *ghbn = &arg->ghbn;
+    struct hostent *he;
+    int len;
+    char key[256];
+    DWORD start = GetTickCount();
+
+    /* blk_async() stops the resolver once the request is cancelled */
+    he = gethostbyname_ex(ghbn->name, arg);
+    stat_time(OWS_API_RESOLVE, start);
+    if (base->cancel) {
+        /* no reply, the app may have freed the buffer */
+        if (he)
+            freehostent(he);
+        return;
+    }
+    if (!he) {
+        /* for all we know the resolver timed out: not cached */
+        GHBN_ERR(ghbn, WSAHOST_NOT_FOUND);
+        return;
+    }
+    dns_fold(key, ghbn->name, sizeof(key));
+    dns_insert(&dns_fwd, key, he, 0);
+    len = pack_hostent(ghbn->buf, ghbn->buflen, he);
+    freehostent(he);
+    GHBN_RET(ghbn, len);
+}
+
+static int AsyncGetHostByName(struct async_base *base)
+{
+    struct per_async *arg = (struct per_async *)base;
+
+    if (arg->ghbn.tries)
+        return dns_step(arg);
+    if (base->cancel)
+        return 1;
+    if (dns_start(arg))
+        return 0;
+    _AsyncGetHostByName(base);
+    return 1;
+}
+
+static void _AsyncGetHostByAddr(struct async_base *base)
+{
+    struct per_async *arg = (struct per_async *)base;
+    struct GHBN *ghbn = &arg->ghbn;
+    struct per_task *task =
+            (struct per_task *)GetWindowLong(base->disp->hWnd, 0);
+    struct async_base *prev = task->blk_lookup;
+    struct hostent FAR *he;
+    char key[16];
+    DWORD start = GetTickCount();
+
+    task->blk_lookup = base;
+    he = gethostbyaddr(ghbn->addr, ghbn->len, ghbn->type);
+    task->blk_lookup = prev;
+    stat_time(OWS_API_RESOLVE, start);
+    if (base->cancel)
+        return;
+    if (!he) {
+        GHBN_ERR(ghbn, WSAHOST_NOT_FOUND);
+        return;
+    }
+    if (dns_addr_key(key, ghbn->addr, ghbn->len, ghbn->type))
+        dns_insert(&dns_rev, key, he, 0);
+    /* libd2sock owns the result */
+    GHBN_RET(ghbn, pack_hostent(ghbn->buf, ghbn->buflen, he));
+}
+
+static int AsyncGetHostByAddr(struct async_base *base)
+{
+    if (!base->cancel)
+        _AsyncGetHostByAddr(base);
+    return 1;
+}
+
+/* answer from cache: the handle is only used for the reply */
+static HANDLE async_cached(HWND hWnd, u_int wMsg, struct dns_entry *ent,
+                           char FAR *buf, int buflen)
+{
+    HANDLE id = async_id();
+    int len;
+
+    stats.posts++;
+    if (ent->he) {
+        len = pack_hostent(buf, buflen, ent->he);
+        PostMessage(hWnd, wMsg, id,
+                WSAMAKEASYNCREPLY(len, len > buflen ? WSAENOBUFS : 0));
+    } else
+        PostMessage(hWnd, wMsg, id, WSAMAKEASYNCREPLY(0, ent->err));
+    return id;
+}
+
+static HANDLE async_start(struct per_task *task, HWND hWnd, u_int wMsg,
+                          struct per_async **ret)
+{
+    int i;
+    struct per_async *async;
+
+    if (task_full(task))
+        return 0;
+    i = async_slot_alloc();
+    if (i < 0) {
+        _WSAE(task->wsa_err) = WSAENOBUFS;
+        return 0;
+    }
+    async = async_tab[i].async;
+    if (!async) {
+        async = malloc(sizeof(struct per_async));
+        if (!async) {
+            async_slot_free(i);
+            _WSAE(task->wsa_err) = WSAENOBUFS;
+            return 0;
+        }
+        async_tab[i].async = async;
+    }
+    memset(async, 0, sizeof(struct per_async));
+    async->base.aid = I_ASYNC;
+    async->ghbn.id = ASYNC_HANDLE(i, async_tab[i].gen);
+    async->ghbn.hWnd = hWnd;
+    async->ghbn.wMsg = wMsg;
+    *ret = async;
+    return async->ghbn.id;
+}
+
+HANDLE pascal far WSAAsyncGetHostByName(HWND hWnd, u_int wMsg,
+					const char FAR *name,
+					char FAR *buf, int buflen)
+{
+    struct per_task *task = task_find(GetCurrentTask());
+    HANDLE id;
+    struct per_async *async;
+    struct dns_entry *ent;
+    char key[256];
+
+    _ENT();
+    assert(task);
+    stat_call(OWS_API_ASYNCGETHOSTBYNAME);
+    if (!name || !buf || buflen < 0) {
+        _WSAE(task->wsa_err) = WSAEINVAL;
+        return 0;
+    }
+
+    dns_fold(key, name, sizeof(key));
+    ent = dns_lookup(&dns_fwd, key);
+    if (ent)
+        return async_cached(hWnd, wMsg, ent, buf, buflen);
+
+    id = async_start(task, hWnd, wMsg, &async);
+    if (!id)
+        return 0;
+    async->base.handler = AsyncGetHostByName;
+    async->ghbn.name = malloc(strlen(name) + 1);
+    if (!async->ghbn.name) {
+        async_slot_free(ASYNC_IDX(id));
+        _WSAE(task->wsa_err) = WSAENOBUFS;
+        return 0;
+    }
+    strcpy(async->ghbn.name, name);
+    async->ghbn.buf = buf;
+    async->ghbn.buflen = buflen;
+
+    if (async_add(task, &async->base)) {
+        free(async->ghbn.name);
+        async_slot_free(ASYNC_IDX(id));
+        _WSAE(task->wsa_err) = WSANO_RECOVERY;
+        return 0;
+    }
+    _LVE();
+    return id;
+}
+
+HANDLE pascal far WSAAsyncGetHostByAddr(HWND hWnd, u_int wMsg,
+					const char FAR *addr, int len,
+					int type, char FAR *buf,
+					int buflen)
+{
+    struct per_task *task = task_find(GetCurrentTask());
+    HANDLE id;
+    struct per_async *async;
+    struct dns_entry *ent;
+    char key[16];
+
+    _ENT();
+    assert(task);
+    stat_call(OWS_API_ASYNCGETHOSTBYADDR);
+    if (!addr || len <= 0 || len > sizeof(async->ghbn.addr) ||
+            !buf || buflen < 0) {
+        _WSAE(task->wsa_err) = WSAEINVAL;
+        return 0;
+    }
+
+    if (dns_addr_key(key, addr, len, type)) {
+        ent = dns_lookup(&dns_rev, key);
+        if (ent)
+            return async_cached(hWnd, wMsg, ent, buf, buflen);
+    }
+
+    id = async_start(task, hWnd, wMsg, &async);
+    if (!id)
+        return 0;
+    async->base.handler = AsyncGetHostByAddr;
+    /* the caller's address may not outlive this call */
+    memcpy(async->ghbn.addr, addr, len);
+    async->ghbn.len = len;
+    async->ghbn.type = type;
+    async->ghbn.buf = buf;
+    async->ghbn.buflen = buflen;
+
+    if (async_add(task, &async->base)) {
+        async_slot_free(ASYNC_IDX(id));
+        _WSAE(task->wsa_err) = WSANO_RECOVERY;
+        return 0;
+    }
+    _LVE();
+    return id;
+}
+
+/* Note: WSAAsyncGetXByY() (above) return 0 as failure.
+ *       Other WSA funcs (below) return 0 as success. */
+
+int pascal far WSACancelAsyncRequest(HANDLE hAsyncTaskHandle)
+{
+    struct per_task *task = task_find(GetCurrentTask());
+    struct async_slot *slot;
+
+    _ENT();
+    assert(task);
+    stat_call(OWS_API_CANCELASYNC);
+    if (hAsyncTaskHandle && ASYNC_IDX(hAsyncTaskHandle) < 0) {
+        _WSAE(task->wsa_err) = WSAEALREADY;
+        return SOCKET_ERROR;
+    }
+    slot = async_slot_find(hAsyncTaskHandle);
+    if (!slot) {
+        _WSAE(task->wsa_err) = WSAEINVAL;
+        return SOCKET_ERROR;
+    }
+    /* another task's run may have answered it from the resolver socket
+     * before its own run saw to it */
+    if (!slot->used || slot->async->base.done ||
+            slot->async->ghbn.answered) {
+        _WSAE(task->wsa_err) = WSAEALREADY;
+        return SOCKET_ERROR;
+    }
+    /* No reply is posted. The handle is dead and the slot free right
+     * away; the record goes when the dispatcher drops the request, a
+     * lookup in progress is stopped by blk_async(). */
+    slot->async->base.cancel++;
+    slot->async = NULL;
+    slot->cancelled = 1;
+    async_slot_free(slot - async_tab);
+    return 0;
+}
+
+#define _FREAD(lEvent) (!!((lEvent) & FD_READ))
+#define _FWRITE(lEvent) (!!((lEvent) & FD_WRITE))
+#define _FOOB(lEvent) (!!((lEvent) & FD_OOB))
+#define _FACCEPT(lEvent) (!!((lEvent) & FD_ACCEPT))
+#define _FCONNECT(lEvent) (!!((lEvent) & FD_CONNECT))
+#define _FCLOSE(lEvent) (!!((lEvent) & FD_CLOSE))
+
+/* A full app queue stops posting for this run. The caller keeps the
+ * event armed then, so it is posted again later, not lost. */
+static int asel_post(struct per_asel *arg, long event, int err)
+{
+    struct dispatcher *disp = arg->base.disp;
+    WORD wait;
+
+    TRACE(TR_POST, arg->hWnd, arg->wMsg, WSAMAKESELECTREPLY(event, err));
+    disp->budget--;
+    if (!PostMessage(arg->hWnd, arg->wMsg, arg->s,
+            WSAMAKESELECTREPLY(event, err))) {
+        disp->st.post_fails++;
+        disp->budget = 0;
+        return 0;
+    }
+    stats.posts++;
+    disp->st.posts++;
+    if (event & (FD_READ | FD_WRITE | FD_OOB | FD_ACCEPT)) {
+        wait = (WORD)GetTickCount() - socks.since[arg->s];
+        disp->st.wait_ms += wait;
+        if (wait > disp->st.wait_max)
+            disp->st.wait_max = wait;
+    }
+    disp->events++;
+    return 1;
+}
+
+/* post an event and disarm it, or leave it armed for the next run */
+static int asel_fire(struct per_asel *arg, long event, int err)
+{
+    if (!asel_post(arg, event, err))
+        return 0;
+    socks.armed[arg->s] &= ~event;
+    return 1;
+}
+
+/* select() conditions the armed events wait for. A registration
+ * with FD_ACCEPT is taken to be on a listening socket: there read
+ * readiness means a pending connection. */
+static long asel_want(struct per_asel *asel)
+{
+    long armed = socks.armed[asel->s];
+    long ev = armed & (FD_READ | FD_WRITE | FD_OOB);
+
+    if (asel->lEvent & FD_ACCEPT)
+        ev = (ev & ~FD_READ) | ((armed & FD_ACCEPT) ? FD_READ : 0);
+    return ev;
+}
+
+static int AsyncSelect(struct async_base *base)
+{
+    struct per_asel *arg = (struct per_asel *)base;
+    BYTE *armed = &socks.armed[arg->s];
+    int fread = _FREAD(*armed);
+    int fwrite = _FWRITE(*armed);
+    int foob = _FOOB(*armed);
+    int faccept = _FACCEPT(*armed);
+    int fconnect = _FCONNECT(*armed);
+    int fclose = _FCLOSE(*armed);
+    int err;
+
+    _ENT();
+
+    DEBUG_STR("\tfd:%i event:0x%lx (fread:%i fwrite:%i foob:%i faccept:%i fconnect:%i fclose:%i)\n",
+            arg->s, (long)*armed, fread, fwrite, foob, faccept, fconnect, fclose);
+    DEBUG_STR("\tcancel:%i closed:%i\n", base->cancel, base->closed);
+    if (!base->cancel && !base->closed) {
+        if (arg->state = 0) {
+            arg->state++;
+            /* do initialization here */
+            d2s_set_blocking_arg(arg->s, base);
+            d2s_set_close_arg(arg->s, arg);
+        }
+
+        if (fconnect) {
+            err = aconnect(arg->s);
+            if (err) {
+                switch (errno) {
+                    case EAGAIN:
+                        debug_out("\tkeeps waiting\n");
+                        return 0;
+                    case EIO:
+                        asel_fire(arg, FD_CONNECT, WSAECONNREFUSED);
+                        debug_out("\tconnect failed\n");
+                        return 0;
+                    /* other errors: ignore fconnect */
+                }
+            } else {
+                asel_fire(arg, FD_CONNECT, 0);
+                debug_out("\tconnected\n");
+                return 0;
+            }
+        }
+
+        if (fread || fwrite || foob || faccept) {
+            long ready = socks.revents[arg->s];
+
+            /* what could not be posted stays for the next run */
+            socks.revents[arg->s] = 0;
+            if ((ready & FD_READ) && faccept) {
+                if (!asel_fire(arg, FD_ACCEPT, 0))
+                    socks.revents[arg->s] |= FD_READ;
+                debug_out("\taccept\n");
+            } else if ((ready & FD_READ) && !(arg->lEvent & FD_ACCEPT)) {
+                if (!asel_fire(arg, FD_READ, 0))
+                    socks.revents[arg->s] |= FD_READ;
+                debug_out("\tread\n");
+            }
+            if (ready & FD_WRITE) {
+                if (!asel_fire(arg, FD_WRITE, 0))
+                    socks.revents[arg->s] |= FD_WRITE;
+                debug_out("\twrite\n");
+            }
+            if (ready & FD_OOB) {
+                if (!asel_fire(arg, FD_OOB, 0))
+                    socks.revents[arg->s] |= FD_OOB;
+                debug_out("\toob\n");
+            }
+        }
+        asel_poll(arg, asel_want(arg));
+        /* stays registered until cancelled or closed: the socket
+         * calls re-enable what was posted, see asel_rearm() */
+        return 0;
+    }
+
+    if (fclose && base->closed && !base->cancel) {
+        if (!asel_fire(arg, FD_CLOSE, 0))
+            return 0;
+        debug_out("\tclosed\n");
+    }
+
+    /* on cancel the socket's state may already belong to a new
+     * registration, so then don't touch */
+    if (!base->cancel) {
+        assert(arg == sock_asel(arg->s));
+        asel_poll(arg, 0);
+        socks.asel[arg->s] = 0;
+        d2s_set_close_arg(arg->s, NULL);
+    } else {
+        assert(arg != sock_asel(arg->s));
+    }
+    if (base->closed)
+        closesocket(arg->s);
+    DEBUG_STR("async select finished, fd=%i\n", arg->s);
+    return 1;
+}
+
+static void CancelAS(int s)
+{
+    struct per_asel *asel = sock_asel(s);
+
+    _ENT();
+    if (!asel)
+        return;
+    d2s_set_close_arg(s, NULL);
+    asel_poll(asel, 0);
+    socks.asel[s] = 0;
+    asel->base.cancel++;
+}
+
+int pascal far WSAAsyncSelect(SOCKET s, HWND hWnd, u_int wMsg, long lEvent)
+{
+    struct per_task *task = task_find(GetCurrentTask());
+    int fread = _FREAD(lEvent);
+    int fwrite = _FWRITE(lEvent);
+    int foob = _FOOB(lEvent);
+    int faccept = _FACCEPT(lEvent);
+    int fconnect = _FCONNECT(lEvent);
+    int fclose = _FCLOSE(lEvent);
+    struct per_asel *asel;
+
+    _ENT();
+    assert(task);
+    stat_call(OWS_API_ASYNCSELECT);
+    DEBUG_STR("\tfd:%i event:0x%lx (fread:%i fwrite:%i foob:%i faccept:%i fconnect:%i fclose:%i)\n",
+            s, lEvent, fread, fwrite, foob, faccept, fconnect, fclose);
+    TRACE(TR_ASEL, s, 0, lEvent);
+    CancelAS(s);
+    if (!lEvent)
+        return 0;
+    if (!SOCK_OK(s)) {
+        _WSAE(task->wsa_err) = WSAENOTSOCK;
+        return SOCKET_ERROR;
+    }
+    if (task_full(task))
+        return SOCKET_ERROR;
+
+    asel = pool_alloc(&asel_pool);
+    if (!asel) {
+        _WSAE(task->wsa_err) = WSAENOBUFS;
+        return SOCKET_ERROR;
+    }
+    asel->base.aid = I_ASEL;
+    asel->base.handler = AsyncSelect;
+    asel->hWnd = hWnd;
+    asel->wMsg = wMsg;
+    asel->lEvent = lEvent;
+    asel->s = s;
+    if (async_add(task, &asel->base)) {
+        pool_free(&asel_pool, asel);
+        _WSAE(task->wsa_err) = WSANO_RECOVERY;
+        return SOCKET_ERROR;
+    }
+    socks.asel[s] = pool_idx(&asel_pool, asel) + 1;
+    socks.armed[s] = (BYTE)lEvent;
+    socks.revents[s] = 0;
+    socks.task[s] = task->task;
+    /* non-blocking from now on, as Winsock 1.1 has it */
+    if ((socks.flags[s] & (SF_NBIO | SF_NBKNOWN)) != (SF_NBIO | SF_NBKNOWN)) {
+        u_long on = 1;
+
+        socks.flags[s] &= ~(SF_NBIO | SF_NBKNOWN);
+        if (!ioctlsocket(s, FIONBIO, &on))
+            socks.flags[s] |= SF_NBIO | SF_NBKNOWN;
+    }
+    /* only to have the close hook called for it */
+    d2s_set_close_arg(s, asel);
+    return 0;
+}
+
+int pascal far WSAStartup(WORD wVersionRequired, LPWSADATA lpWSAData)
+{
+    const char desc[] =
+		"Open Winsock - winsock-1.1 for OpenWatcom. "
+		"Copyright 2025 @stsp. "
+		"Open Winsock is free software, GPLv3+.";
+    struct per_task *task;
+
+    _ENT();
+    stat_call(OWS_API_STARTUP);
+    lpWSAData->wVersion = 0x0101;
+    lpWSAData->wHighVersion = 0x0101;
+    assert(sizeof(desc) <= 256);
+    strcpy(lpWSAData->szDescription, desc);
+    strcpy(lpWSAData->szSystemStatus, "Ready.");
+    lpWSAData->iMaxSockets = MAX_SOCKETS;
+    lpWSAData->iMaxUdpDg = max_udp_dg;
+    lpWSAData->lpVendorInfo = 0;
+    if (wVersionRequired == 0x0001)
+	return WSAVERNOTSUPPORTED;
+    task = task_find(GetCurrentTask());
+    if (task) {
+        /* every WSAStartup() needs its own WSACleanup() */
+        task->refs++;
+        return 0;
+    }
+    if (!task_alloc(GetCurrentTask()))
+        return WSASYSNOTREADY;
+    netdb_init();
+    /* resolver settings apply from the first app on */
+    if (ntasks == 1)
+        dns_init();
+    return 0;
+}
+
+int pascal far WSACleanup(void)
+{
+    struct per_task *task = task_find(GetCurrentTask());
+
+    _ENT();
+    stat_call(OWS_API_CLEANUP);
+    if (!task) {
+        /* no record to keep it in, WSAGetLastError() knows */
+        errno = 0;
+        return SOCKET_ERROR;
+    }
+    if (!--task->refs)
+        task_free(task);
+    return 0;
+}
+
+void pascal far WSASetLastError(int iError)
+{
+    struct per_task *task = task_find(GetCurrentTask());
+
+    _ENT();
+    assert(task);
+    stat_call(OWS_API_SETLASTERROR);
+    _WSAE(task->wsa_err) = iError;
+}
+
+static int from_errno(int e)
+{
+    switch (e) {
+        case EAGAIN:
+            return WSAEWOULDBLOCK;
+        case EINVAL:
+            return WSAENOTCONN;  // oops
+        case EMSGSIZE:
+            return WSAEMSGSIZE;
+    }
+    DEBUG_STR("\tunsupported errno %i\n", e);
+    return 0;
+}
+
+int pascal far WSAGetLastError(void)
+{
+    int ret;
+    struct per_task *task = task_find(GetCurrentTask());
+
+    _ENT();
+    stat_call(OWS_API_GETLASTERROR);
+    /* all a task that isn't started can be told */
+    if (!task)
+        return WSANOTINITIALISED;
+    if (errno)
+        ret = from_errno(errno);
+    else
+        ret = task->wsa_err;
+    _WSAE(task->wsa_err) = 0;
+    TRACE(TR_ERR, 0, ret, 0);
+    DEBUG_STR("\treturning %i\n", ret);
+    return ret;
+}
+
+BOOL pascal far WSAIsBlocking(void)
+{
+    struct per_task *task = task_find(GetCurrentTask());
+
+    _ENT();
+    assert(task);
+    stat_call(OWS_API_ISBLOCKING);
+    return task->blocking;
+}
+
+int pascal far WSAUnhookBlockingHook(void)
+{
+    FARPROC BlockingHook;
+    struct per_task *task = task_find(GetCurrentTask());
+
+    _ENT();
+    assert(task);
+    stat_call(OWS_API_UNHOOKBLOCKINGHOOK);
+    task->BlockingHook = NULL;
+    return 0;
+}
+
+FARPROC pascal far WSASetBlockingHook(FARPROC lpBlockFunc)
+{
+    FARPROC ret;
+    struct per_task *task = task_find(GetCurrentTask());
+
+    _ENT();
+    assert(task);
+    stat_call(OWS_API_SETBLOCKINGHOOK);
+    ret = task->BlockingHook;
+    task->BlockingHook = lpBlockFunc;
+    return ret;
+}
+
+int pascal far WSACancelBlockingCall(void)
+{
+    struct per_task *task = task_find(GetCurrentTask());
+
+    _ENT();
+    assert(task);
+    stat_call(OWS_API_CANCELBLOCKINGCALL);
+    if (task->blocking)
+        task->cancel++;
+    return 0;
+}
+
+int pascal far OWSGetPoolStats(int pool, struct ows_pool_stats FAR *stats)
+{
+    _ENT();
+    switch (pool) {
+    case OWS_POOL_ASEL:
+        *stats = asel_pool.st;
+        return 0;
+    }
+    return WSAEINVAL;
+}
+
+int pascal far OWSGetTaskStats(HTASK htask, struct ows_task_stats FAR *st)
+{
+    struct per_task *task = task_find(htask ? htask : GetCurrentTask());
+
+    _ENT();
+    if (!task || !st)
+        return WSAEINVAL;
+    task->disp.st.queue = task->disp.count;
+    *st = task->disp.st;
+    return 0;
+}
+
+int pascal far OWSGetDnsStats(int cache, struct ows_dns_stats FAR *stats)
+{
+    _ENT();
+    switch (cache) {
+    case OWS_DNS_FORWARD:
+        *stats = dns_fwd.st;
+        return 0;
+    case OWS_DNS_REVERSE:
+        *stats = dns_rev.st;
+        return 0;
+    }
+    return WSAEINVAL;
+}
+
+int pascal far OWSFlushDnsCache(void)
+{
+    _ENT();
+    dns_flush(&dns_fwd);
+    dns_flush(&dns_rev);
+    return 0;
+}
+
+int pascal far OWSGetStats(struct ows_stats FAR *st)
+{
+    _ENT();
+    if (!st)
+        return WSAEINVAL;
+    stats.asel_pool = asel_pool.st;
+    *st = stats;
+    return 0;
+}
+
+/* the gauges (queue, pools) are kept */
+int pascal far OWSResetStats(void)
+{
+    int queue = stats.queue;
+    struct per_task *t;
+    int i;
+
+    _ENT();
+    memset(&stats, 0, sizeof(stats));
+    stats.queue = stats.queue_hwm = queue;
+    for (i = 0; i < TASK_HASH; i++) {
+        for (t = tasks[i]; t; t = t->next) {
+            memset(&t->disp.st, 0, sizeof(t->disp.st));
+            t->disp.st.queue_hwm = t->disp.count;
+        }
+    }
+    asel_pool.st.hwm = asel_pool.st.used;
+    asel_pool.st.fails = 0;
+    return 0;
+}
+
+static const char *stat_names[OWS_API_COUNT] = {
+    "accept", "bind", "closesocket", "connect", "getpeername",
+    "getsockname", "getsockopt", "ioctlsocket", "recv", "recvfrom",
+    "select", "send", "sendto", "setsockopt", "shutdown", "socket",
+    "gethostbyaddr", "gethostbyname", "getprotobyname",
+    "getprotobynumber", "getservbyname", "getservbyport",
+    "WSAAsyncSelect", "WSAAsyncGetHostByAddr", "WSAAsyncGetHostByName",
+    "WSAAsyncGetProtoByNumber", "WSAAsyncGetProtoByName",
+    "WSAAsyncGetServByPort", "WSAAsyncGetServByName",
+    "WSACancelAsyncRequest", "WSASetBlockingHook", "WSAUnhookBlockingHook",
+    "WSAGetLastError", "WSASetLastError", "WSACancelBlockingCall",
+    "WSAIsBlocking", "WSAStartup", "WSACleanup", "OWSSendV", "OWSRecvV",
+    "resolve",
+};
+
+int pascal far OWSDumpStats(LPCSTR path)
+{
+    char line[160];
+    HFILE f;
+    int i, b, n;
+
+    _ENT();
+    if (!path)
+        return WSAEINVAL;
+    f = _lcreat(path, 0);
+    if (f == HFILE_ERROR)
+        return WSAEINVAL;
+    n = sprintf(line, "polls %lu timer sets %lu fires %lu kicks %lu "
+            "hooks %lu posts %lu\r\n", (u_long)stats.polls,
+            (u_long)stats.timer_sets, (u_long)stats.timer_fires,
+            (u_long)stats.kicks, (u_long)stats.hooks, (u_long)stats.posts);
+    _lwrite(f, line, n);
+    n = sprintf(line, "dns queries %lu retries %lu\r\n",
+            (u_long)stats.dns_queries, (u_long)stats.dns_retries);
+    _lwrite(f, line, n);
+    n = sprintf(line, "queue %i hwm %i, asel pool %i/%i hwm %i fails %i\r\n",
+            stats.queue, stats.queue_hwm, asel_pool.st.used,
+            asel_pool.st.size, asel_pool.st.hwm, asel_pool.st.fails);
+    _lwrite(f, line, n);
+    for (i = 0; i < TASK_HASH; i++) {
+        struct per_task *t;
+
+        for (t = tasks[i]; t; t = t->next) {
+            struct ows_task_stats *ts = &t->disp.st;
+
+            n = sprintf(line, "task %04x posts %lu deferred %lu fails %lu "
+                    "wait %lu ms max %lu, queue %i hwm %i refused %i\r\n",
+                    t->task, (u_long)ts->posts, (u_long)ts->deferred,
+                    (u_long)ts->post_fails, (u_long)ts->wait_ms,
+                    (u_long)ts->wait_max, t->disp.count, ts->queue_hwm,
+                    ts->refused);
+            _lwrite(f, line, n);
+        }
+    }
+    for (i = 0; i < OWS_API_COUNT; i++) {
+        struct ows_api_stats *a = &stats.api[i];
+
+        if (!a->calls)
+            continue;
+        n = sprintf(line, "%-24s %8lu calls %8lu ms max %6lu:",
+                stat_names[i], (u_long)a->calls, (u_long)a->total_ms,
+                (u_long)a->max_ms);
+        for (b = 0; b < OWS_HIST_BUCKETS; b++)
+            n += sprintf(line + n, " %lu", (u_long)a->hist[b]);
+        strcpy(line + n, "\r\n");
+        _lwrite(f, line, n + 2);
+    }
+    _lclose(f);
+    return 0;
+}
+
+/* Write the trace ring, oldest record first, to a file or a device
+ * such as COM1. The ring keeps running. */
+int pascal far OWSDumpTrace(LPCSTR path)
+{
+    struct trace_hdr hdr;
+    unsigned count, start, first;
+    HFILE f;
+    int err = 0;
+
+    if (!trace.recs || !path)
+        return WSAEINVAL;
+    f = _lcreat(path, 0);
+    if (f == HFILE_ERROR)
+        return WSAEINVAL;
+    count = trace.total > trace.mask ? trace.mask + 1 : (unsigned)trace.total;
+    start = (trace.head - count) & trace.mask;
+    first = min(count, trace.mask + 1 - start);
+
+    memcpy(hdr.magic, "OWST", 4);
+    hdr.version = 1;
+    hdr.recsize = sizeof(struct trace_rec);
+    hdr.count = count;
+    hdr.pad = 0;
+    hdr.total = trace.total;
+    first *= sizeof(struct trace_rec);
+    count *= sizeof(struct trace_rec);
+    if (_lwrite(f, (LPCSTR)&hdr, sizeof(hdr)) != sizeof(hdr) ||
+            _lwrite(f, (LPCSTR)&trace.recs[start], first) != first)
+        err = WSAEINVAL;
+    /* the part that wrapped, a 0-byte write would truncate */
+    if (!err && count > first && _lwrite(f, (LPCSTR)trace.recs,
+            count - first) != count - first)
+        err = WSAEINVAL;
+    _lclose(f);
+    return err;
+}
+
+static struct hostent FAR *host_cached(struct per_task *task,
+                                       struct dns_entry *ent)
+{
+    if (!ent->he) {
+        _WSAE(task->wsa_err) = ent->err;
+        return NULL;
+    }
+    if (pack_hostent(task->hostbuf, sizeof(task->hostbuf), ent->he) >
+            sizeof(task->hostbuf)) {
+        _WSAE(task->wsa_err) = WSANO_RECOVERY;
+        return NULL;
+    }
+    return (struct hostent FAR *)task->hostbuf;
+}
+
+/* Failed lookups are only cached from DnsServer replies, which say
+ * why; here a NULL may as well come from WSACancelBlockingCall(). */
+struct hostent FAR * pascal far ws_gethostbyname(const char FAR *name)
+{
+    struct per_task *task = task_find(GetCurrentTask());
+    struct dns_entry *ent;
+    struct hostent FAR *he;
+    char key[256];
+    DWORD start = GetTickCount();
+
+    _ENT();
+    assert(task);
+    if (!name) {
+        _WSAE(task->wsa_err) = WSAEFAULT;
+        return NULL;
+    }
+    dns_fold(key, name, sizeof(key));
+    ent = dns_lookup(&dns_fwd, key);
+    if (ent) {
+        he = host_cached(task, ent);
+    } else {
+        he = gethostbyname(name);
+        if (he)
+            dns_insert(&dns_fwd, key, he, 0);
+    }
+    stat_time(OWS_API_GETHOSTBYNAME, start);
+    return he;
+}
+
+struct hostent FAR * pascal far ws_gethostbyaddr(const char FAR *addr,
+                                                int len, int type)
+{
+    struct per_task *task = task_find(GetCurrentTask());
+    struct dns_entry *ent;
+    struct hostent FAR *he;
+    char key[16];
+    int cacheable;
+    DWORD start = GetTickCount();
+
+    _ENT();
+    assert(task);
+    if (!addr) {
+        _WSAE(task->wsa_err) = WSAEFAULT;
+        return NULL;
+    }
+    cacheable = dns_addr_key(key, addr, len, type);
+    ent = cacheable ? dns_lookup(&dns_rev, key) : NULL;
+    if (ent) {
+        he = host_cached(task, ent);
+    } else {
+        he = gethostbyaddr(addr, len, type);
+        if (he && cacheable)
+            dns_insert(&dns_rev, key, he, 0);
+    }
+    stat_time(OWS_API_GETHOSTBYADDR, start);
+    return he;
+}
+
+static void *netdb_result(struct per_task *task,
+                          const struct netdb_rec FAR *rec)
+{
+    if (!rec) {
+        _WSAE(task->wsa_err) = WSANO_DATA;
+        return NULL;
+    }
+    if (pack_netdb(task->hostbuf, sizeof(task->hostbuf), rec) >
+            sizeof(task->hostbuf)) {
+        _WSAE(task->wsa_err) = WSANO_RECOVERY;
+        return NULL;
+    }
+    return task->hostbuf;
+}
+
+struct servent FAR * pascal far ws_getservbyname(const char FAR *name,
+                                                const char FAR *proto)
+{
+    struct per_task *task = task_find(GetCurrentTask());
+
+    _ENT();
+    assert(task);
+    stat_call(OWS_API_GETSERVBYNAME);
+    if (!name) {
+        _WSAE(task->wsa_err) = WSAEFAULT;
+        return NULL;
+    }
+    return netdb_result(task, netdb_by_name(&serv_db, name, proto));
+}
+
+struct servent FAR * pascal far ws_getservbyport(int port,
+                                                const char FAR *proto)
+{
+    struct per_task *task = task_find(GetCurrentTask());
+
+    _ENT();
+    assert(task);
+    stat_call(OWS_API_GETSERVBYPORT);
+    return netdb_result(task, netdb_by_num(&serv_db, ntohs(port), proto));
+}
+
+struct protoent FAR * pascal far ws_getprotobyname(const char FAR *name)
+{
+    struct per_task *task = task_find(GetCurrentTask());
+
+    _ENT();
+    assert(task);
+    stat_call(OWS_API_GETPROTOBYNAME);
+    if (!name) {
+        _WSAE(task->wsa_err) = WSAEFAULT;
+        return NULL;
+    }
+    return netdb_result(task, netdb_by_name(&proto_db, name, NULL));
+}
+
+struct protoent FAR * pascal far ws_getprotobynumber(int number)
+{
+    struct per_task *task = task_find(GetCurrentTask());
+
+    _ENT();
+    assert(task);
+    stat_call(OWS_API_GETPROTOBYNUMBER);
+    return netdb_result(task, netdb_by_num(&proto_db, number, NULL));
+}
+
+/* Tell blk_func() what a possibly blocking libd2sock call waits for.
+ * Calls made from inside the blocking hook don't override it. */
+static int blk_enter(SOCKET s, long ev)
+{
+    struct per_task *task = task_find(GetCurrentTask());
+
+    if (!task || task->blocking)
+        return 0;
+    task->blk_sock = s;
+    task->blk_ev = ev;
+    return 1;
+}
+
+static void blk_leave(int entered)
+{
+    if (entered)
+        task_find(GetCurrentTask())->blk_sock = INVALID_SOCKET;
+}
+
+static void task_activity(void)
+{
+    struct per_task *task = task_find(GetCurrentTask());
+
+    if (task)
+        disp_activity(&task->disp);
+}
+
+/* Winsock 1.1 re-enabling: a call that consumes an event makes the
+ * next one postable again. Readiness is level-triggered, so if the
+ * condition still holds the event is posted on the next poll. */
+static void asel_rearm(SOCKET s, long events)
+{
+    struct per_asel *asel = sock_asel(s);
+
+    if (!asel || asel->base.cancel || asel->base.closed)
+        return;
+    events &= asel->lEvent & ~socks.armed[s];
+    if (!events)
+        return;
+    socks.armed[s] |= events;
+    asel_poll(asel, asel_want(asel));
+}
+
+#define RA_PASS (-2)          /* not for read-ahead, go to the host */
+
+/* Buffering only applies to stream sockets, datagrams must not be
+ * merged. Checked once per socket. */
+static int sock_stream(SOCKET s)
+{
+    int type, len = sizeof(type);
+
+    if (!(socks.flags[s] & SF_PROBED)) {
+        if (getsockopt(s, SOL_SOCKET, SO_TYPE, (char FAR *)&type, &len))
+            return 0;
+        socks.flags[s] |= SF_PROBED | (type == SOCK_STREAM ? SF_STREAM : 0);
+    }
+    return socks.flags[s] & SF_STREAM;
+}
+
+static struct rdahead *ra_alloc(SOCKET s)
+{
+    struct rdahead *ra;
+
+    if (!sock_stream(s))
+        return NULL;
+    ra = malloc(sizeof(struct rdahead) + ra_size);
+    if (ra)
+        memset(ra, 0, sizeof(struct rdahead));
+    return ra;
+}
+
+static void ra_free(SOCKET s)
+{
+    struct rdahead *ra;
+
+    if (!SOCK_OK(s) || !(ra = socks.ra[s]))
+        return;
+    socks.ra[s] = NULL;
+    if (ra->busy)
+        ra->dead++;
+    else
+        free(ra);
+}
+
+/* Serve recv() from the read-ahead buffer, refilling it when empty.
+ * Reads that fill the buffer by themselves go to the host as is. */
+static int ra_recv(SOCKET s, char FAR *buf, int len, int flags)
+{
+    struct rdahead *ra;
+    int ret;
+
+    if (!SOCK_OK(s) || !ra_size || len <= 0 || (flags & MSG_OOB))
+        return RA_PASS;
+    ra = socks.ra[s];
+    if (!ra || ra->head == ra->tail) {
+        int blk;
+
+        if (len >= ra_size)
+            return RA_PASS;
+        if (!ra)
+            ra = socks.ra[s] = ra_alloc(s);
+        if (!ra || ra->busy)
+            return RA_PASS;
+        ra->busy++;
+        blk = blk_enter(s, FD_READ);
+        ret = recv(s, ra->data, ra_size, 0);
+        blk_leave(blk);
+        ra->busy--;
+        ra->head = 0;
+        ra->tail = max(ret, 0);
+        if (ret <= 0) {
+            if (ra->dead)
+                free(ra);
+            return ret;
+        }
+    }
+    ret = min(len, ra->tail - ra->head);
+    memcpy(buf, ra->data + ra->head, ret);
+    if (!(flags & MSG_PEEK))
+        ra->head += ret;
+    if (ra->dead)
+        free(ra);
+    return ret;
+}
+
+#define WC_PASS (-2)          /* not for write combining, go to the host */
+#define WC_GONE (-3)          /* wc_flush() freed the buffer */
+
+/* errors that have no errno for WSAGetLastError() to map */
+static int wc_fail(int err)
+{
+    struct per_task *task = task_find(GetCurrentTask());
+
+    if (task)
+        _WSAE(task->wsa_err) = err;
+    return SOCKET_ERROR;
+}
+
+static void wc_unlink(struct wcomb *wc)
+{
+    struct wcomb **p;
+
+    if (!wc->task)
+        return;
+    for (p = &wc->task->wc_head; *p != wc; p = &(*p)->next);
+    *p = wc->next;
+    wc->task = NULL;
+}
+
+/* Send out what is buffered. What the host doesn't take for now stays
+ * pending; other errors drop the data and stick to the socket. The app
+ * may close the socket from the blocking hook, then the buffer is freed
+ * on the way out and WC_GONE returned. */
+static int wc_flush(struct wcomb *wc)
+{
+    int ret, blk;
+
+    if (!wc->len)
+        return 0;
+    /* called from the hook while this socket's flush waits */
+    if (wc->busy)
+        return wc_fail(WSAEINPROGRESS);
+    wc->busy++;
+    blk = blk_enter(wc->s, FD_WRITE);
+    ret = send(wc->s, wc->data, wc->len, 0);
+    blk_leave(blk);
+    wc->busy--;
+    TRACE(TR_SEND, wc->s, ret, 0);
+    if (ret > 0) {
+        /* more may have been added while the hook ran */
+        wc->len -= ret;
+        memmove(wc->data, wc->data + ret, wc->len);
+    } else if (ret == SOCKET_ERROR && errno && errno != EAGAIN &&
+            errno != EINTR) {
+        wc->err = errno;
+        wc->len = 0;
+    }
+    if (!wc->len)
+        wc_unlink(wc);
+    if (wc->dead || (wc->closing && !wc->len)) {
+        if (wc->closing)
+            closesocket(wc->s);
+        free(wc);
+        return WC_GONE;
+    }
+    if (!wc->len)
+        return 0;
+    /* a partial send leaves errno as the last call had it */
+    errno = EAGAIN;
+    return SOCKET_ERROR;
+}
+
+/* report a sticky error the way libd2sock does */
+static int wc_error(struct wcomb *wc)
+{
+    errno = wc->err;
+    wc->err = 0;
+    return SOCKET_ERROR;
+}
+
+/* flush a socket before a call that must not overtake its data */
+static int wc_drain(SOCKET s)
+{
+    struct wcomb *wc = SOCK_OK(s) ? socks.wc[s] : NULL;
+    int ret;
+
+    if (!wc)
+        return 0;
+    ret = wc_flush(wc);
+    if (ret == WC_GONE)
+        return wc_fail(WSAENOTSOCK);
+    if (ret)
+        return wc->err ? wc_error(wc) : SOCKET_ERROR;
+    return 0;
+}
+
+/* Flush all pending sockets of a task. Flushing may run the blocking
+ * hook and the app may close sockets meanwhile, so each pass rescans
+ * the list instead of keeping a pointer into it. */
+static void wc_flush_task(struct per_task *task)
+{
+    struct wcomb *wc;
+
+    if (!task || !task->wc_head)
+        return;
+    task->wc_pass++;
+    for (;;) {
+        for (wc = task->wc_head; wc && wc->pass == task->wc_pass;
+                wc = wc->next);
+        if (!wc)
+            break;
+        wc->pass = task->wc_pass;
+        /* one in progress further up the stack carries on by itself */
+        if (!wc->busy)
+            wc_flush(wc);
+    }
+}
+
+static int WriteFlush(struct async_base *base)
+{
+    struct per_task *task = ((struct per_flush *)base)->task;
+
+    _ENT();
+    wc_flush_task(task);
+    /* host buffers full: stay queued and retry on the next poll */
+    return base->cancel || !task->wc_head;
+}
+
+/* First byte buffered: make sure the dispatcher flushes it soon.
+ * Returns WC_GONE if it had to flush right away and that freed wc. */
+static int wc_queue(struct wcomb *wc)
+{
+    struct per_task *task = task_find(GetCurrentTask());
+    struct per_flush *fl;
+
+    if (wc->task || !task)
+        return 0;
+    wc->task = task;
+    wc->next = task->wc_head;
+    task->wc_head = wc;
+    fl = &task->flush;
+    if (fl->queued) {
+        /* finished but not reaped yet: just run it again */
+        fl->base.done = 0;
+        disp_kick(fl->base.disp);
+        return 0;
+    }
+    memset(fl, 0, sizeof(*fl));
+    fl->base.aid = I_FLUSH;
+    fl->base.handler = WriteFlush;
+    fl->task = task;
+    if (async_add(task, &fl->base))
+        return wc_flush(wc) == WC_GONE ? WC_GONE : 0;
+    fl->queued = 1;
+    return 0;
+}
+
+static int wc_send(SOCKET s, const char FAR *buf, int len, int flags)
+{
+    struct wcomb *wc;
+    int n;
+
+    if (!SOCK_OK(s))
+        return WC_PASS;
+    wc = socks.wc[s];
+    if (wc && wc->err)
+        return wc_error(wc);
+    if (!wc_size || flags || len <= 0 || len >= wc_size ||
+            (socks.flags[s] & SF_NODELAY))
+        return wc_drain(s) ? SOCKET_ERROR : WC_PASS;
+    if (!wc) {
+        if (!sock_stream(s))
+            return WC_PASS;
+        wc = malloc(sizeof(struct wcomb) + wc_size);
+        if (!wc)
+            return WC_PASS;
+        memset(wc, 0, sizeof(struct wcomb));
+        wc->s = s;
+        socks.wc[s] = wc;
+    }
+    /* the app may close the socket from the hook meanwhile */
+    if (wc->len + len > wc_size && wc_flush(wc) == WC_GONE)
+        return wc_fail(WSAENOTSOCK);
+    if (wc->err)
+        return wc_error(wc);
+    n = min(len, wc_size - wc->len);
+    if (!n) {
+        errno = EAGAIN;
+        return SOCKET_ERROR;
+    }
+    memcpy(wc->data + wc->len, buf, n);
+    wc->len += n;
+    /* taken either way, a close from the hook loses it like any data */
+    if (wc_queue(wc) != WC_GONE && wc->len == wc_size)
+        wc_flush(wc);
+    return n;
+}
+
+static void wc_free(SOCKET s)
+{
+    struct wcomb *wc;
+
+    if (!SOCK_OK(s) || !(wc = socks.wc[s]))
+        return;
+    socks.wc[s] = NULL;
+    wc_unlink(wc);
+    if (wc->busy)
+        wc->dead++;
+    else
+        free(wc);
+}
+
+static void wc_drop_task(struct per_task *task)
+{
+    struct wcomb *wc;
+
+    while ((wc = task->wc_head)) {
+        wc_unlink(wc);
+        /* closed by the app and still not flushed: the data is lost */
+        if (!wc->closing)
+            continue;
+        if (wc->busy) {
+            wc->dead++;
+        } else {
+            closesocket(wc->s);
+            free(wc);
+        }
+    }
+}
+
+/* closesocket() with data the host doesn't take yet. Winsock 1.1 apps
+ * don't retry a graceful close, so the handle goes now and the socket
+ * once the dispatcher has flushed it. The host keeps the number. */
+static void wc_close(SOCKET s)
+{
+    struct wcomb *wc = socks.wc[s];
+
+    socks.wc[s] = NULL;
+    wc->closing++;
+    CancelAS(s);
+    sock_free(s);
+}
+
+#define UQ_REC(len) ((sizeof(struct dgram) + (len) + 1) & ~1)
+
+/* Pull in what waits behind the datagram just received. The app may
+ * read them with larger buffers than this one, so each is read whole
+ * and only cut when it is served. One that doesn't fit the space left
+ * is kept aside and ends the pass. */
+static void uq_fill(SOCKET s, struct udpq *q)
+{
+    struct sockaddr_in from;
+    struct dgram *d;
+    int n, ret, err, fromlen;
+
+    if (!uq_buf && !(uq_buf = malloc(max_udp_dg)))
+        return;
+    for (n = 0; n < q->burst && !q->held; n++) {
+        fromlen = sizeof(from);
+        ret = recvfrom(s, uq_buf, max_udp_dg, 0,
+                (struct sockaddr FAR *)&from, &fromlen);
+        if (ret == SOCKET_ERROR && errno != EMSGSIZE) {
+            if (errno == EAGAIN)
+                q->burst = max(q->burst / 2, 1);
+            return;
+        }
+        err = ret == SOCKET_ERROR ? EMSGSIZE : 0;
+        if (err)
+            ret = max_udp_dg;
+        if (uq_size - q->tail >= UQ_REC(ret)) {
+            d = (struct dgram *)(q->data + q->tail);
+            q->tail += UQ_REC(ret);
+            q->count++;
+        } else {
+            d = malloc(sizeof(struct dgram) + ret);
+            if (!d)
+                return;
+            q->held = d;
+        }
+        d->err = err;
+        d->len = ret;
+        d->from = from;
+        memcpy(d + 1, uq_buf, ret);
+    }
+    q->burst = min(q->burst * 2, UQ_BURST);
+}
+
+/* the next datagram to serve */
+static struct dgram *uq_next(struct udpq *q)
+{
+    return q->count ? (struct dgram *)(q->data + q->head) : q->held;
+}
+
+static int uq_serve(struct udpq *q, char FAR *buf, int len, int flags,
+                    struct sockaddr FAR *from, int FAR *fromlen)
+{
+    struct dgram *d = uq_next(q);
+    int n = min(len, d->len);
+    int err = n < d->len ? EMSGSIZE : d->err;
+
+    memcpy(buf, d + 1, n);
+    if (from && fromlen) {
+        memcpy(from, &d->from, min(*fromlen, sizeof(d->from)));
+        *fromlen = sizeof(d->from);
+    }
+    if (!(flags & MSG_PEEK)) {
+        if (d == q->held) {
+            free(d);
+            q->held = NULL;
+        } else {
+            q->head += UQ_REC(d->len);
+            if (!--q->count)
+                q->head = q->tail = 0;
+        }
+    }
+    if (err) {
+        errno = err;
+        return SOCKET_ERROR;
+    }
+    return n;
+}
+
+/* recv()/recvfrom() on a datagram socket: from the queue if it holds
+ * anything, else from the host, filling the queue on the way. */
+static int uq_recv(SOCKET s, char FAR *buf, int len, int flags,
+                   struct sockaddr FAR *from, int FAR *fromlen)
+{
+    struct udpq *q;
+    int ret, err;
+
+    if (!SOCK_OK(s) || (flags & MSG_OOB))
+        return RA_PASS;
+    q = socks.uq[s];
+    if (UQ_LEN(s))
+        return uq_serve(q, buf, len, flags, from, fromlen);
+    /* a blocking socket could block on the datagrams behind */
+    if (!uq_size || (flags & MSG_PEEK) || len <= 0 ||
+            !(socks.flags[s] & SF_NBIO) || sock_stream(s))
+        return RA_PASS;
+    if (!q) {
+        q = malloc(sizeof(struct udpq) + uq_size);
+        if (!q)
+            return RA_PASS;
+        memset(q, 0, sizeof(struct udpq));
+        q->burst = 1;
+        socks.uq[s] = q;
+    }
+    ret = recvfrom(s, buf, len, flags, from, fromlen);
+    if (ret != SOCKET_ERROR || errno == EMSGSIZE) {
+        err = errno;
+        uq_fill(s, q);
+        errno = err;
+    }
+    return ret;
+}
+
+static void uq_free(SOCKET s)
+{
+    if (SOCK_OK(s) && socks.uq[s]) {
+        free(socks.uq[s]->held);
+        free(socks.uq[s]);
+        socks.uq[s] = NULL;
+    }
+}
+
+static const struct {
+    int level;
+    int optname;
+} sc_opts[SC_NOPT] = {
+    { SOL_SOCKET, SO_DEBUG },
+    { SOL_SOCKET, SO_REUSEADDR },
+    { SOL_SOCKET, SO_KEEPALIVE },
+    { SOL_SOCKET, SO_DONTROUTE },
+    { SOL_SOCKET, SO_BROADCAST },
+    { SOL_SOCKET, SO_LINGER },
+    { SOL_SOCKET, SO_OOBINLINE },
+    { SOL_SOCKET, SO_SNDBUF },
+    { SOL_SOCKET, SO_RCVBUF },
+    { SOL_SOCKET, SO_TYPE },
+    { IPPROTO_TCP, TCP_NODELAY },
+};
+
+/* index into sc_opts[], -1 for what must come from the host (SO_ERROR) */
+static int sc_opt(int level, int optname)
+{
+    int i;
+
+    for (i = 0; i < SC_NOPT; i++) {
+        if (sc_opts[i].level == level && sc_opts[i].optname == optname)
+            return i;
+    }
+    return -1;
+}
+
+static struct sockc *sc_get(SOCKET s)
+{
+    if (!SOCK_OK(s))
+        return NULL;
+    if (!socks.sc[s])
+        socks.sc[s] = calloc(1, sizeof(struct sockc));
+    return socks.sc[s];
+}
+
+static void sc_drop(SOCKET s, int what)
+{
+    struct sockc *sc = SOCK_OK(s) ? socks.sc[s] : NULL;
+
+    if (!sc)
+        return;
+    if (what & SC_NAME)
+        sc->namelen = 0;
+    if (what & SC_PEER)
+        sc->peerlen = 0;
+    if (what & SC_NREAD)
+        sc->nr_ok = 0;
+}
+
+/* what a recv() changes: the data waiting, and the peer if it's gone */
+static void sc_recv(SOCKET s, int ret)
+{
+    if (!ret || (ret == SOCKET_ERROR && errno != EAGAIN))
+        sc_drop(s, SC_NREAD | SC_PEER);
+    else
+        sc_drop(s, SC_NREAD);
+}
+
+/* the socket is gone, forget all about it */
+static void sock_free(SOCKET s)
+{
+    ra_free(s);
+    wc_free(s);
+    uq_free(s);
+    if (SOCK_OK(s)) {
+        free(socks.sc[s]);
+        socks.sc[s] = NULL;
+        socks.flags[s] = 0;
+        socks.task[s] = 0;
+    }
+}
+
+/* WSACleanup(): sockets the task left open are closed, data not yet
+ * sent is dropped */
+static void sock_drop_task(HTASK task)
+{
+    SOCKET s;
+
+    for (s = 0; s < MAX_SOCKETS; s++) {
+        if (socks.task[s] != task)
+            continue;
+        CancelAS(s);
+        closesocket(s);
+        sock_free(s);
+    }
+}
+
+static void sock_done(void)
+{
+    SOCKET s;
+
+    for (s = 0; s < MAX_SOCKETS; s++)
+        sock_free(s);
+    free(uq_buf);
+    uq_buf = NULL;
+}
+
+/* datagrams the host stack can't carry, see MaxUdpDg */
+static int dg_too_big(SOCKET s, int len)
+{
+    struct per_task *task;
+
+    if (len <= max_udp_dg || sock_stream(s))
+        return 0;
+    task = task_find(GetCurrentTask());
+    if (task)
+        _WSAE(task->wsa_err) = WSAEMSGSIZE;
+    return 1;
+}
+
+/* Socket calls below wrap the libd2sock ones (see winsock.def) to let
+ * the dispatcher know the app is busy with its sockets. */
+
+/* a new host socket, refused as if the host had run out of them if it
+ * is past the tables */
+static SOCKET sock_new(SOCKET s)
+{
+    struct per_task *task;
+
+    if (s == INVALID_SOCKET || SOCK_OK(s))
+        return s;
+    closesocket(s);
+    task = task_find(GetCurrentTask());
+    if (task)
+        _WSAE(task->wsa_err) = WSAEMFILE;
+    return INVALID_SOCKET;
+}
+
+SOCKET pascal far ws_accept(SOCKET s, struct sockaddr FAR *addr,
+                           int FAR *addrlen)
+{
+    DWORD start = GetTickCount();
+    int blk = blk_enter(s, FD_READ);
+    SOCKET ret = accept(s, addr, addrlen);
+
+    blk_leave(blk);
+    ret = sock_new(ret);
+    if (ret != INVALID_SOCKET) {
+        socks.flags[ret] = SF_PROBED | SF_STREAM;
+        socks.task[ret] = GetCurrentTask();
+    }
+    stat_time(OWS_API_ACCEPT, start);
+    asel_rearm(s, FD_ACCEPT);
+    task_activity();
+    return ret;
+}
+
+int pascal far ws_bind(SOCKET s, const struct sockaddr FAR *addr,
+                       int namelen)
+{
+    int ret;
+
+    stat_call(OWS_API_BIND);
+    ret = bind(s, addr, namelen);
+    sc_drop(s, SC_NAME);
+    return ret;
+}
+
+int pascal far ws_connect(SOCKET s, const struct sockaddr FAR *name,
+                          int namelen)
+{
+    DWORD start = GetTickCount();
+    int blk = blk_enter(s, FD_WRITE);
+    int ret = connect(s, name, namelen);
+
+    blk_leave(blk);
+    sc_drop(s, SC_NAME | SC_PEER);
+    stat_time(OWS_API_CONNECT, start);
+    task_activity();
+    return ret;
+}
+
+int pascal far ws_getpeername(SOCKET s, struct sockaddr FAR *name,
+                              int FAR *namelen)
+{
+    struct sockc *sc = sc_get(s);
+    int ret;
+
+    stat_call(OWS_API_GETPEERNAME);
+    if (sc && sc->peerlen && *namelen >= sc->peerlen) {
+        memcpy(name, &sc->peer, sc->peerlen);
+        *namelen = sc->peerlen;
+        return 0;
+    }
+    ret = getpeername(s, name, namelen);
+    if (!ret && sc && *namelen <= sizeof(sc->peer)) {
+        memcpy(&sc->peer, name, *namelen);
+        sc->peerlen = *namelen;
+    }
+    return ret;
 }
 
-HANDLE pascal far WSAAsyncGetHostByAddr(HWND hWnd, u_int wMsg,
-					const char FAR *addr, int len,
-					int type, char FAR *buf,
-					int buflen)
+int pascal far ws_getsockname(SOCKET s, struct sockaddr FAR *name,
+                              int FAR *namelen)
 {
-    _ENT();
-    /* TODO! */
-    return 0;
-}
+    struct sockc *sc = sc_get(s);
+    int ret;
 
-/* Note: WSAAsyncGetXByY() (above) return 0 as failure.
- *       Other WSA funcs (below) return 0 as success. */
+    stat_call(OWS_API_GETSOCKNAME);
+    if (sc && sc->namelen && *namelen >= sc->namelen) {
+        memcpy(name, &sc->name, sc->namelen);
+        *namelen = sc->namelen;
+        return 0;
+    }
+    ret = getsockname(s, name, namelen);
+    /* not while unbound, the first send or connect picks the port */
+    if (!ret && sc && *namelen <= sizeof(sc->name) &&
+            ((struct sockaddr_in FAR *)name)->sin_port) {
+        memcpy(&sc->name, name, *namelen);
+        sc->namelen = *namelen;
+    }
+    return ret;
+}
 
-int pascal far WSACancelAsyncRequest(HANDLE hAsyncTaskHandle)
+int pascal far ws_getsockopt(SOCKET s, int level, int optname,
+                             char FAR *optval, int FAR *optlen)
 {
-    struct per_async *async;
+    int i = sc_opt(level, optname);
+    struct sockc *sc = i >= 0 ? sc_get(s) : NULL;
+    int ret;
 
-    _ENT();
-    assert(hAsyncTaskHandle > 0 && hAsyncTaskHandle <= MAX_ASYNC);
-    async = &asyncs[hAsyncTaskHandle - 1];
-    async->base.cancel++;
-    return 0;
+    stat_call(OWS_API_GETSOCKOPT);
+    if (sc && (sc->opts & (1 << i)) && *optlen >= sc->optlen[i]) {
+        memcpy(optval, &sc->optval[i], sc->optlen[i]);
+        *optlen = sc->optlen[i];
+        return 0;
+    }
+    ret = getsockopt(s, level, optname, optval, optlen);
+    if (!ret && sc && *optlen <= sizeof(long)) {
+        memcpy(&sc->optval[i], optval, *optlen);
+        sc->optlen[i] = *optlen;
+        sc->opts |= 1 << i;
+    }
+    return ret;
 }
 
-#define _FREAD(lEvent) (!!((lEvent) & FD_READ))
-#define _FWRITE(lEvent) (!!((lEvent) & FD_WRITE))
-#define _FOOB(lEvent) (!!((lEvent) & FD_OOB))
-#define _FACCEPT(lEvent) (!!((lEvent) & FD_ACCEPT))
-#define _FCONNECT(lEvent) (!!((lEvent) & FD_CONNECT))
-#define _FCLOSE(lEvent) (!!((lEvent) & FD_CLOSE))
-
-static int AsyncSelect(struct async_base *base)
+int pascal far ws_recv(SOCKET s, char FAR *buf, int len, int flags)
 {
-    struct per_asel *arg = (struct per_asel *)base;
-    int fread = _FREAD(arg->lEvent);
-    int fwrite = _FWRITE(arg->lEvent);
-    int foob = _FOOB(arg->lEvent);
-    int faccept = _FACCEPT(arg->lEvent);
-    int fconnect = _FCONNECT(arg->lEvent);
-    int fclose = _FCLOSE(arg->lEvent);
-    int err;
+    DWORD start = GetTickCount();
+    int ret;
 
-    _ENT();
+    wc_flush_task(task_find(GetCurrentTask()));
+    ret = ra_recv(s, buf, len, flags);
+    if (ret == RA_PASS)
+        ret = uq_recv(s, buf, len, flags, NULL, NULL);
+    if (ret == RA_PASS) {
+        int blk = blk_enter(s, FD_READ);
 
-    DEBUG_STR("\tfd:%i event:0x%lx (fread:%i fwrite:%i foob:%i faccept:%i fconnect:%i fclose:%i)\n",
-            arg->s, arg->lEvent, fread, fwrite, foob, faccept, fconnect, fclose);
-    DEBUG_STR("\tcancel:%i closed:%i\n", base->cancel, base->closed);
-    if (!base->cancel && !base->closed) {
-        if (arg->state = 0) {
-            arg->state++;
-            /* do initialization here */
-            d2s_set_blocking_arg(arg->s, base);
-            d2s_set_close_arg(arg->s, arg);
-        }
+        ret = recv(s, buf, len, flags);
+        blk_leave(blk);
+    }
+    sc_recv(s, ret);
+    stat_time(OWS_API_RECV, start);
+    TRACE(TR_RECV, s, ret, flags);
+    asel_rearm(s, (flags & MSG_OOB) ? FD_OOB : FD_READ);
+    task_activity();
+    return ret;
+}
 
-        if (fconnect) {
-            err = aconnect(arg->s);
-            if (err) {
-                switch (errno) {
-                    case EAGAIN:
-                        debug_out("\tkeeps waiting\n");
-                        return 0;
-                    case EIO:
-                        PostMessage(arg->hWnd, arg->wMsg, arg->s,
-                                WSAMAKESELECTREPLY(FD_CONNECT, WSAECONNREFUSED));
-                        arg->lEvent &= ~FD_CONNECT;
-                        debug_out("\tconnect failed\n");
-                        return 0;
-                    /* other errors: ignore fconnect */
-                }
-            } else {
-                PostMessage(arg->hWnd, arg->wMsg, arg->s,
-                        WSAMAKESELECTREPLY(FD_CONNECT, 0));
-                arg->lEvent &= ~FD_CONNECT;
-                debug_out("\tconnected\n");
-                return 0;
-            }
-        }
+int pascal far ws_recvfrom(SOCKET s, char FAR *buf, int len, int flags,
+                           struct sockaddr FAR *from, int FAR *fromlen)
+{
+    DWORD start = GetTickCount();
+    int ret;
 
-        if (fread || fwrite || foob) {
-            fd_set r, w, b;
-            struct timeval tv = {0};
-            int res;
-
-            FD_ZERO(&r);
-            FD_ZERO(&w);
-            FD_ZERO(&b);
-            if (fread)
-                FD_SET(arg->s, &r);
-            if (fwrite)
-                FD_SET(arg->s, &w);
-            if (foob)
-                FD_SET(arg->s, &b);
-            res = select(arg->s + 1,
-                         fread ? &r : NULL,
-                         fwrite ? &w : NULL,
-                         foob ? &b : NULL,
-                         &tv);
-            if (res <= 0)
-                return 0;
-            if (FD_ISSET(arg->s, &r)) {
-                PostMessage(arg->hWnd, arg->wMsg, arg->s,
-                        WSAMAKESELECTREPLY(FD_READ, 0));
-                arg->lEvent &= ~FD_READ;
-                debug_out("\tread\n");
-            }
-            if (FD_ISSET(arg->s, &w)) {
-                PostMessage(arg->hWnd, arg->wMsg, arg->s,
-                        WSAMAKESELECTREPLY(FD_WRITE, 0));
-                arg->lEvent &= ~FD_WRITE;
-                debug_out("\twrite\n");
-            }
-            if (FD_ISSET(arg->s, &b)) {
-                PostMessage(arg->hWnd, arg->wMsg, arg->s,
-                        WSAMAKESELECTREPLY(FD_OOB, 0));
-                arg->lEvent &= ~FD_OOB;
-                debug_out("\toob\n");
-            }
-        }
+    wc_flush_task(task_find(GetCurrentTask()));
+    /* only stream sockets read ahead, and there from is ignored */
+    ret = RA_LEN(s) ? ra_recv(s, buf, len, flags) :
+            uq_recv(s, buf, len, flags, from, fromlen);
+    if (ret == RA_PASS) {
+        int blk = blk_enter(s, FD_READ);
 
-        if (arg->lEvent)
-            return 0;
+        ret = recvfrom(s, buf, len, flags, from, fromlen);
+        blk_leave(blk);
     }
+    sc_recv(s, ret);
+    stat_time(OWS_API_RECVFROM, start);
+    TRACE(TR_RECV, s, ret, flags);
+    asel_rearm(s, (flags & MSG_OOB) ? FD_OOB : FD_READ);
+    task_activity();
+    return ret;
+}
 
-    if (fclose && base->closed && !base->cancel) {
-        PostMessage(arg->hWnd, arg->wMsg, arg->s,
-                WSAMAKESELECTREPLY(FD_CLOSE, 0));
-        arg->lEvent &= ~FD_CLOSE;
-        debug_out("\tclosed\n");
-    }
+int pascal far ws_send(SOCKET s, const char FAR *buf, int len, int flags)
+{
+    DWORD start = GetTickCount();
+    int ret = dg_too_big(s, len) ? SOCKET_ERROR : wc_send(s, buf, len, flags);
 
-    /* on cancel the arg already re-used, so then don't touch */
-    if (!base->cancel) {
-        assert(arg == d2s_get_close_arg(arg->s));
-        d2s_set_close_arg(arg->s, NULL);
-    } else {
-        assert(arg != d2s_get_close_arg(arg->s));
+    if (ret == WC_PASS) {
+        int blk = blk_enter(s, FD_WRITE);
+
+        ret = send(s, buf, len, flags);
+        blk_leave(blk);
     }
-    if (base->closed)
-        closesocket(arg->s);
-    free(arg);
-    DEBUG_STR("async select finished, fd=%i\n", arg->s);
-    return 1;
+    stat_time(OWS_API_SEND, start);
+    TRACE(TR_SEND, s, ret, flags);
+    /* FD_WRITE only matters once the send buffer filled up */
+    if (ret == SOCKET_ERROR && errno == EAGAIN)
+        asel_rearm(s, FD_WRITE);
+    task_activity();
+    return ret;
 }
 
-static void CancelAS(int s)
+int pascal far ws_sendto(SOCKET s, const char FAR *buf, int len, int flags,
+                         const struct sockaddr FAR *to, int tolen)
 {
-    struct per_asel *asel = d2s_get_close_arg(s);
+    DWORD start = GetTickCount();
+    int ret = dg_too_big(s, len) ? SOCKET_ERROR : wc_drain(s);
 
-    _ENT();
-    if (!asel)
-        return;
-    d2s_set_close_arg(s, NULL);
-    asel->base.cancel++;
+    if (!ret) {
+        int blk = blk_enter(s, FD_WRITE);
+
+        ret = sendto(s, buf, len, flags, to, tolen);
+        blk_leave(blk);
+    }
+    stat_time(OWS_API_SENDTO, start);
+    TRACE(TR_SEND, s, ret, flags);
+    if (ret == SOCKET_ERROR && errno == EAGAIN)
+        asel_rearm(s, FD_WRITE);
+    task_activity();
+    return ret;
 }
 
-int pascal far WSAAsyncSelect(SOCKET s, HWND hWnd, u_int wMsg, long lEvent)
+int pascal far ws_closesocket(SOCKET s)
 {
-    struct per_task *task = task_find(GetCurrentTask());
-    int fread = _FREAD(lEvent);
-    int fwrite = _FWRITE(lEvent);
-    int foob = _FOOB(lEvent);
-    int faccept = _FACCEPT(lEvent);
-    int fconnect = _FCONNECT(lEvent);
-    int fclose = _FCLOSE(lEvent);
-    struct per_asel *asel;
-    HWND wnd;
+    int ret;
 
-    _ENT();
-    DEBUG_STR("\tfd:%i event:0x%lx (fread:%i fwrite:%i foob:%i faccept:%i fconnect:%i fclose:%i)\n",
-            s, lEvent, fread, fwrite, foob, faccept, fconnect, fclose);
-    CancelAS(s);
-    if (!lEvent)
+    stat_call(OWS_API_CLOSESOCKET);
+    /* Only a lingering close of a non-blocking socket may have to be
+     * made again. Other flush errors lose the data as a reset would,
+     * and so does SO_LINGER with no timeout. */
+    if (SOCK_OK(s) && !(socks.flags[s] & SF_ABORT) && wc_drain(s) &&
+            errno == EAGAIN) {
+        if (socks.flags[s] & SF_LINGER)
+            return SOCKET_ERROR;
+        wc_close(s);
         return 0;
-
-    wnd = CreateWindow(WSAClassName, __FUNCTION__,
-                        WS_OVERLAPPEDWINDOW,
-                        CW_USEDEFAULT, CW_USEDEFAULT,
-                        CW_USEDEFAULT, CW_USEDEFAULT,
-                        NULL, NULL,
-                        hinst,
-                        NULL);
-    if (!wnd) {
-        _WSAE(task->wsa_err) = WSANO_RECOVERY;
-        return SOCKET_ERROR;
     }
-
-    asel = malloc(sizeof(struct per_asel));
-    memset(asel, 0, sizeof(struct per_asel));
-    asel->base.aid = I_ASEL;
-    asel->base.handler = AsyncSelect;
-    asel->hWnd = hWnd;
-    asel->wMsg = wMsg;
-    asel->lEvent = lEvent;
-    asel->s = s;
-    d2s_set_close_arg(s, asel);
-    PostMessage(wnd, WM_USER, 0, (long)asel);
-    return 0;
+    ret = closesocket(s);
+    if (!ret)
+        sock_free(s);
+    return ret;
 }
 
-int pascal far WSAStartup(WORD wVersionRequired, LPWSADATA lpWSAData)
+SOCKET pascal far ws_socket(int af, int type, int protocol)
 {
-    const char desc[] =
-		"Open Winsock - winsock-1.1 for OpenWatcom. "
-		"Copyright 2025 @stsp. "
-		"Open Winsock is free software, GPLv3+.";
-    _ENT();
-    lpWSAData->wVersion = 0x0101;
-    lpWSAData->wHighVersion = 0x0101;
-    assert(sizeof(desc) <= 256);
-    strcpy(lpWSAData->szDescription, desc);
-    strcpy(lpWSAData->szSystemStatus, "Ready.");
-    lpWSAData->iMaxSockets = 256;
-    lpWSAData->iMaxUdpDg = 512;
-    lpWSAData->lpVendorInfo = 0;
-    if (wVersionRequired == 0x0001)
-	return WSAVERNOTSUPPORTED;
-    task_alloc(GetCurrentTask());
-    return 0;
+    SOCKET ret = sock_new(socket(af, type, protocol));
+
+    stat_call(OWS_API_SOCKET);
+    if (ret != INVALID_SOCKET) {
+        socks.flags[ret] = SF_PROBED | SF_NBKNOWN |
+                (type == SOCK_STREAM ? SF_STREAM : 0);
+        socks.task[ret] = GetCurrentTask();
+    }
+    return ret;
 }
 
-int pascal far WSACleanup(void)
+int pascal far ws_shutdown(SOCKET s, int how)
 {
-    struct per_task *task = task_find(GetCurrentTask());
-
-    _ENT();
-    assert(task);
-    task_free(task);
-    return 0;
+    stat_call(OWS_API_SHUTDOWN);
+    if (how && wc_drain(s))
+        return SOCKET_ERROR;
+    return shutdown(s, how);
 }
 
-void pascal far WSASetLastError(int iError)
+int pascal far ws_setsockopt(SOCKET s, int level, int optname,
+                             const char FAR *optval, int optlen)
 {
-    struct per_task *task = task_find(GetCurrentTask());
+    int ret = setsockopt(s, level, optname, optval, optlen);
+    int i = sc_opt(level, optname);
 
-    _ENT();
-    assert(task);
-    _WSAE(task->wsa_err) = iError;
+    stat_call(OWS_API_SETSOCKOPT);
+    /* the host may round what was set, so it's read back when asked */
+    if (i >= 0 && SOCK_OK(s) && socks.sc[s])
+        socks.sc[s]->opts &= ~(1 << i);
+    if (!ret && level == IPPROTO_TCP && optname == TCP_NODELAY &&
+            SOCK_OK(s) && optval) {
+        int on = optlen >= sizeof(int) ? *(const int FAR *)optval : *optval;
+
+        if (on) {
+            socks.flags[s] |= SF_NODELAY;
+            wc_drain(s);
+        } else {
+            socks.flags[s] &= ~SF_NODELAY;
+        }
+    }
+    if (!ret && level == SOL_SOCKET && optname == SO_LINGER &&
+            SOCK_OK(s) && optval) {
+        const struct linger FAR *l = (const struct linger FAR *)optval;
+
+        socks.flags[s] &= ~(SF_LINGER | SF_ABORT);
+        if (l->l_onoff)
+            socks.flags[s] |= l->l_linger ? SF_LINGER : SF_ABORT;
+    }
+    return ret;
 }
 
-static int from_errno(int e)
+int pascal far ws_ioctlsocket(SOCKET s, long cmd, u_long FAR *argp)
 {
-    switch (e) {
-        case EAGAIN:
-            return WSAEWOULDBLOCK;
-        case EINVAL:
-            return WSAENOTCONN;  // oops
+    struct sockc *sc = NULL;
+    int ret;
+
+    stat_call(OWS_API_IOCTLSOCKET);
+    /* for datagrams it's the size of the next one */
+    if (cmd == FIONREAD && UQ_LEN(s)) {
+        *argp = uq_next(socks.uq[s])->len;
+        return 0;
     }
-    DEBUG_STR("\tunsupported errno %i\n", e);
-    return 0;
+    if (cmd == FIONREAD && nr_ttl && (sc = sc_get(s)) && sc->nr_ok &&
+            GetTickCount() - sc->stamp < nr_ttl) {
+        *argp = sc->nread + RA_LEN(s);
+        return 0;
+    }
+    /* setting the mode it already has */
+    if (cmd == FIONBIO && SOCK_OK(s) && (socks.flags[s] & SF_NBKNOWN) &&
+            !*argp == !(socks.flags[s] & SF_NBIO))
+        return 0;
+    ret = ioctlsocket(s, cmd, argp);
+    if (!ret && cmd == FIONREAD) {
+        if (nr_ttl && sc) {
+            sc->nread = *argp;
+            sc->stamp = GetTickCount();
+            sc->nr_ok = 1;
+        }
+        *argp += RA_LEN(s);
+    }
+    if (cmd == FIONBIO && SOCK_OK(s)) {
+        socks.flags[s] &= ~(SF_NBIO | SF_NBKNOWN);
+        if (!ret)
+            socks.flags[s] |= SF_NBKNOWN | (*argp ? SF_NBIO : 0);
+    }
+    return ret;
 }
 
-int pascal far WSAGetLastError(void)
+/* Sockets with data read ahead or queued are readable whatever the
+ * host says, then the host is only polled for the rest. The hits are
+ * per call: the blocking hook may select() again while this one waits. */
+int pascal far ws_select(int nfds, fd_set FAR *readfds, fd_set FAR *writefds,
+                         fd_set FAR *exceptfds,
+                         const struct timeval FAR *timeout)
 {
+    fd_set FAR *sets[3];
+    struct sock_set hits;
+    struct timeval tv = {0};
+    u_int i, j;
     int ret;
-    struct per_task *task = task_find(GetCurrentTask());
+    DWORD start = GetTickCount();
 
-    _ENT();
-    assert(task);
-    if (errno)
-        ret = from_errno(errno);
-    else
-        ret = task->wsa_err;
-    _WSAE(task->wsa_err) = 0;
-    DEBUG_STR("\treturning %i\n", ret);
+    wc_flush_task(task_find(GetCurrentTask()));
+    hits.fd_count = 0;
+    for (i = 0; readfds && i < readfds->fd_count; i++) {
+        SOCKET fd = readfds->fd_array[i];
+
+        if ((RA_LEN(fd) || UQ_LEN(fd)) && hits.fd_count < MAX_SOCKETS)
+            sset_add(&hits, fd);
+    }
+    /* winsock ignores nfds, the host may not */
+    sets[0] = readfds;
+    sets[1] = writefds;
+    sets[2] = exceptfds;
+    nfds = 0;
+    for (j = 0; j < 3; j++) {
+        for (i = 0; sets[j] && i < sets[j]->fd_count; i++) {
+            if ((int)sets[j]->fd_array[i] >= nfds)
+                nfds = sets[j]->fd_array[i] + 1;
+        }
+    }
+    ret = select(nfds, readfds, writefds, exceptfds,
+            hits.fd_count ? &tv : timeout);
+    stat_time(OWS_API_SELECT, start);
+    if (ret == SOCKET_ERROR)
+        return ret;
+    /* new data, or the peer is gone */
+    for (i = 0; readfds && i < readfds->fd_count; i++)
+        sc_drop(readfds->fd_array[i], SC_NREAD | SC_PEER);
+    for (i = 0; i < hits.fd_count; i++) {
+        for (j = 0; j < readfds->fd_count; j++) {
+            if (readfds->fd_array[j] == hits.fd_array[i])
+                break;
+        }
+        /* the result is a subset of the input, so there is room */
+        if (j == readfds->fd_count) {
+            readfds->fd_array[readfds->fd_count++] = hits.fd_array[i];
+            ret++;
+        }
+    }
     return ret;
 }
 
-BOOL pascal far WSAIsBlocking(void)
-{
-    struct per_task *task = task_find(GetCurrentTask());
+/*
+ * Vectored I/O: libd2sock has no gather/scatter calls, so small pieces
+ * are gathered in a bounce buffer and cross to the host as one send()
+ * or recv(). A piece that fills the buffer by itself goes as is.
+ */
+#define IOV_BOUNCE 8192
 
-    _ENT();
-    assert(task);
-    return task->blocking;
+static char *iov_bounce(struct per_task *task)
+{
+    if (task->blocking) {
+        _WSAE(task->wsa_err) = WSAEINPROGRESS;
+        return NULL;
+    }
+    if (!task->iov_buf) {
+        task->iov_buf = malloc(IOV_BOUNCE);
+        if (!task->iov_buf) {
+            _WSAE(task->wsa_err) = WSAENOBUFS;
+            return NULL;
+        }
+    }
+    return task->iov_buf;
 }
 
-int pascal far WSAUnhookBlockingHook(void)
+/* total length of a list, -1 if it has a negative piece */
+static long iov_total(const struct ows_buf FAR *bufs, int nbufs)
 {
-    FARPROC BlockingHook;
-    struct per_task *task = task_find(GetCurrentTask());
+    long total = 0;
+    int i;
 
-    _ENT();
-    assert(task);
-    task->BlockingHook = NULL;
-    return 0;
+    for (i = 0; i < nbufs; i++) {
+        if (bufs[i].len < 0)
+            return -1;
+        total += bufs[i].len;
+    }
+    return total;
 }
 
-FARPROC pascal far WSASetBlockingHook(FARPROC lpBlockFunc)
+int pascal far OWSSendV(SOCKET s, const struct ows_buf FAR *bufs, int nbufs,
+                        int flags)
 {
-    FARPROC ret;
     struct per_task *task = task_find(GetCurrentTask());
+    char *bounce;
+    int i = 0, off = 0, total = 0;
+    long len;
 
     _ENT();
     assert(task);
-    ret = task->BlockingHook;
-    task->BlockingHook = lpBlockFunc;
-    return ret;
+    stat_call(OWS_API_SENDV);
+    /* the count sent must fit the int returned */
+    if (!bufs || nbufs < 0 || (len = iov_total(bufs, nbufs)) < 0 ||
+            len > 32767) {
+        _WSAE(task->wsa_err) = WSAEINVAL;
+        return SOCKET_ERROR;
+    }
+    /* a datagram goes as one, which the bounce buffer limits unless
+     * it's all in one piece */
+    if (len > IOV_BOUNCE && SOCK_OK(s) && !sock_stream(s)) {
+        for (i = 0; i < nbufs && bufs[i].len != len; i++);
+        if (i == nbufs) {
+            _WSAE(task->wsa_err) = WSAEMSGSIZE;
+            return SOCKET_ERROR;
+        }
+        return ws_send(s, bufs[i].buf, bufs[i].len, flags);
+    }
+    bounce = iov_bounce(task);
+    if (!bounce)
+        return SOCKET_ERROR;
+    while (i < nbufs) {
+        const char FAR *p;
+        int n, j, k, o, ret;
+
+        if (bufs[i].len - off >= IOV_BOUNCE) {
+            p = bufs[i].buf + off;
+            n = bufs[i].len - off;
+        } else {
+            for (n = 0, j = i, o = off; j < nbufs && n < IOV_BOUNCE;
+                    j++, o = 0) {
+                k = min(bufs[j].len - o, IOV_BOUNCE - n);
+                memcpy(bounce + n, bufs[j].buf + o, k);
+                n += k;
+            }
+            p = bounce;
+        }
+        if (!n)
+            break;
+        ret = ws_send(s, p, n, flags);
+        if (ret == SOCKET_ERROR)
+            return total ? total : SOCKET_ERROR;
+        total += ret;
+        /* advance past what went out, possibly mid-piece */
+        for (off += ret; i < nbufs && off >= bufs[i].len; i++)
+            off -= bufs[i].len;
+        if (ret < n)
+            break;
+    }
+    return total;
 }
 
-int pascal far WSACancelBlockingCall(void)
+int pascal far OWSRecvV(SOCKET s, struct ows_buf FAR *bufs, int nbufs,
+                        int flags)
 {
     struct per_task *task = task_find(GetCurrentTask());
+    char *bounce;
+    int i, len = 0, ret, k, off;
 
     _ENT();
     assert(task);
-    if (task->blocking)
-        task->cancel++;
-    return 0;
+    stat_call(OWS_API_RECVV);
+    if (!bufs || nbufs < 0 || iov_total(bufs, nbufs) < 0) {
+        _WSAE(task->wsa_err) = WSAEINVAL;
+        return SOCKET_ERROR;
+    }
+    for (i = 0; i < nbufs && len < IOV_BOUNCE; i++)
+        len += bufs[i].len;
+    len = min(len, IOV_BOUNCE);
+    if (nbufs && bufs[0].len >= len)
+        return ws_recv(s, bufs[0].buf, bufs[0].len, flags);
+    bounce = iov_bounce(task);
+    if (!bounce)
+        return SOCKET_ERROR;
+    ret = ws_recv(s, bounce, len, flags);
+    for (i = 0, off = 0; ret > 0 && off < ret; i++) {
+        k = min(bufs[i].len, ret - off);
+        memcpy(bufs[i].buf, bounce + off, k);
+        off += k;
+    }
+    return ret;
 }